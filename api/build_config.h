@@ -1,5 +1,6 @@
 #pragma once
 #include "core.h"
+#include <cstddef>
 
 namespace metabuild METABUILD_PUBLIC
 {
@@ -10,9 +11,21 @@ namespace metabuild METABUILD_PUBLIC
         RELEASE_DEBUGINFO
     };
 
+    enum content_hash_type
+    {
+        HASH_SHA256,
+        HASH_BLAKE3
+    };
+
     struct build_config
     {
         const build_type default_build_type;
+        // how sources and headers are fingerprinted for the compile cache; switching it invalidates every cached object
+        const content_hash_type content_hash;
+        // in megabytes, how large binary_root()/objects may grow before the least recently used objects are evicted
+        const size_t object_store_limit;
+        // a compile cache shared with other checkouts and users, empty for none; METABUILD_SHARED_CACHE or --shared-cache
+        const std::filesystem::path shared_cache;
     };
 
     METABUILD_PUBLIC const build_config& get_build_config();
@@ -0,0 +1,51 @@
+#pragma once
+#include "command.h"
+#include "core.h"
+#include "executable.h"
+#include <vector>
+
+namespace metabuild METABUILD_PUBLIC
+{
+    // builds several targets as one graph: every compile of every target and every link share the same jobs, so one target's link runs
+    // while another is still compiling; targets are referenced, not copied, and must outlive build()
+    class build_graph
+    {
+        std::vector<const executable*> targets;
+
+        int use_threads;
+        size_t mem_budget;
+        bool continue_on_error;
+
+    public:
+        METABUILD_INLINE build_graph() : use_threads(-1), mem_budget(0), continue_on_error(false) {}
+
+        METABUILD_INLINE build_graph& add(const executable& target)
+        {
+            targets.push_back(&target);
+            return *this;
+        }
+
+        // as executable::parallelize, the settings of the targets themselves are not used here
+        METABUILD_INLINE constexpr build_graph& parallelize(int threads = 0)
+        {
+            use_threads = threads;
+            return *this;
+        }
+
+        METABUILD_INLINE constexpr build_graph& memory_budget(size_t megabytes)
+        {
+            mem_budget = megabytes;
+            return *this;
+        }
+
+        // a failed target does not stop the others, only whatever depends on the failure is skipped
+        METABUILD_INLINE constexpr build_graph& keep_going(bool enable = true)
+        {
+            continue_on_error = enable;
+            return *this;
+        }
+
+        // one command per target, in the order they were added
+        METABUILD_PUBLIC std::vector<command> build(bool quiet = false) const;
+    };
+} // namespace metabuild
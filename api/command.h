@@ -1,6 +1,8 @@
 #pragma once
 #include "core.h"
 #include "utils.h"
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
 #include <future>
 #include <span>
@@ -9,7 +11,44 @@
 
 namespace metabuild METABUILD_PUBLIC
 {
-    using program_result = int;
+    // what a finished child cost, as reported by wait4, plus the wall time from launch to exit
+    struct resource_usage
+    {
+        std::chrono::microseconds user_time{};
+        std::chrono::microseconds system_time{};
+        std::chrono::microseconds wall_time{};
+        // in kilobytes
+        long max_rss = 0;
+        long minor_faults = 0;
+        long major_faults = 0;
+
+        // times and faults add up, peaks of different jobs do not, so max_rss keeps the largest
+        METABUILD_INLINE constexpr resource_usage& operator+=(const resource_usage& rhs)
+        {
+            user_time += rhs.user_time;
+            system_time += rhs.system_time;
+            wall_time += rhs.wall_time;
+            max_rss = std::max(max_rss, rhs.max_rss);
+            minor_faults += rhs.minor_faults;
+            major_faults += rhs.major_faults;
+            return *this;
+        }
+    };
+
+    // the wait status of a child; converts to it, so existing status checks keep working
+    class program_result
+    {
+        int status;
+        resource_usage usage;
+
+    public:
+        METABUILD_INLINE constexpr program_result(int status = 0, const resource_usage& usage = {}) : status(status), usage(usage) {}
+
+        METABUILD_INLINE constexpr operator int() const { return status; }
+        METABUILD_INLINE constexpr int get_status() const { return status; }
+        METABUILD_INLINE constexpr const resource_usage& get_usage() const { return usage; }
+    };
+
      using program_arguments = std::vector<std::string>;
      using program_environment = std::unordered_map<std::string, std::string>;
 
@@ -34,7 +73,7 @@ namespace metabuild METABUILD_PUBLIC
         };
         [[nodiscard]] METABUILD_INLINE program_result invoke(const program_arguments& args, const program_environment& env) const
         {
-            return invoke_async(args).get_value();
+            return invoke_async(args, env).get_value();
         }
         [[nodiscard]] METABUILD_PUBLIC lazy<program_result> invoke_async(const program_arguments& args, const program_environment& env) const;
 
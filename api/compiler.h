@@ -17,6 +17,8 @@ namespace metabuild METABUILD_PUBLIC
         const std::string version;
         const std::filesystem::path exec;
 
+        friend class compile_job;
+
     protected:
         compiler(const std::string& vendor, const std::string& name, const std::string& version, const std::filesystem::path& exec);
         virtual std::vector<std::string> parse_flags(const compiler_flags& flags) const = 0;
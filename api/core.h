@@ -18,7 +18,9 @@ namespace metabuild
         COMPILER_NOT_FOUND,
         UNKNOWN_COMPILER,
         BAD_COMPILE_FLAG,
-        UNKNOWN_SRC_TYPE
+        UNKNOWN_SRC_TYPE,
+        BUILD_FAILED,
+        BUILD_INTERRUPTED
     };
 
     class METABUILD_PUBLIC metabuild_error : public std::runtime_error  
@@ -29,11 +29,18 @@ namespace metabuild METABUILD_PUBLIC
         std::string name;
 
         int use_threads;
+        size_t mem_budget;
+        bool continue_on_error;
+
+        friend class build_graph;
 
     public:
+        // parallelize(ADAPTIVE) starts at one job per hardware thread and lets pressure stall information move the width as the build runs
+        METABUILD_INLINE static constexpr int ADAPTIVE = -2;
+
         METABUILD_INLINE executable(const std::string& name, compiler_flags::standard c_std, compiler_flags::standard cxx_standard,
                           const _detail::opt_flags_package& f = {})
-            : name(name), use_threads(-1)
+            : name(name), use_threads(-1), mem_budget(0), continue_on_error(false)
         {
             set_build_type(get_build_config().default_build_type);
             cc_flags = f.c;
@@ -91,6 +98,21 @@ namespace metabuild METABUILD_PUBLIC
             return *this;
         }
 
+        // caps the summed predicted peak memory of parallel compiles, in megabytes; 0 uses what is available when the build starts
+        METABUILD_INLINE constexpr executable& memory_budget(size_t megabytes)
+        {
+            mem_budget = megabytes;
+            return *this;
+        }
+
+        // compile every source even after failures and report all of them at the end, instead of stopping at the first one; objects that
+        // did compile are cached either way
+        METABUILD_INLINE constexpr executable& keep_going(bool enable = true)
+        {
+            continue_on_error = enable;
+            return *this;
+        }
+
         METABUILD_INLINE constexpr executable& libstdcxx()
         {
             ld_flags.libstdcxx();
@@ -18,6 +18,8 @@ namespace metabuild
         const std::string version;
         const std::filesystem::path exec;
 
+        friend class link_job;
+
     protected:
         linker(const std::string& vendor, const std::string& name, const std::string& version, const std::filesystem::path& exec);
         virtual std::vector<std::string> parse_flags(const linker_flags& flags) const = 0;
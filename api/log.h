@@ -10,4 +10,6 @@ namespace metabuild
     METABUILD_PUBLIC void warn(const std::string& str);
     METABUILD_PUBLIC void error(const std::string& str);
     METABUILD_PUBLIC void fatal(const std::string& str);
+    // prints tool output as is, without a prefix or added newline
+    METABUILD_PUBLIC void diagnostic(const std::string& str);
 } // namespace metabuild
@@ -0,0 +1,71 @@
+// throughput of the sha256 backends
+// build from the repository root with:
+//   clang++ -std=c++20 -O3 -DFMT_HEADER_ONLY bench/sha256.cpp meta/utils/sha256.cpp -o sha256_bench
+#include "../meta/utils/sha256.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+inline static constexpr size_t BUFFER_SIZE = 64 << 20;
+
+template <typename Fn>
+static void run(const char* name, size_t bytes, Fn&& fn)
+{
+    // warm up once, then take the best of a few runs
+    fn();
+    double best = 1e30;
+    for (int i = 0; i < 5; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::printf("%-24s %8.3f GB/s\n", name, bytes / best / 1e9);
+}
+
+int main()
+{
+    std::mt19937_64 rng(0);
+    std::vector<uint8_t> data(BUFFER_SIZE);
+    for (auto& i : data)
+        i = rng();
+
+    uint32_t state[8] = {};
+    size_t blocks = BUFFER_SIZE / 64;
+
+    std::printf("sha-ni: %s, avx2: %s\n", sha::has_shani() ? "yes" : "no", sha::has_avx2() ? "yes" : "no");
+
+    run("portable", BUFFER_SIZE, [&] { sha::transform_portable(state, data.data(), blocks); });
+
+    if (sha::has_shani())
+        run("sha-ni", BUFFER_SIZE, [&] { sha::transform_shani(state, data.data(), blocks); });
+
+    if (sha::has_avx2())
+    {
+        // eight lanes, each over its own eighth of the buffer
+        uint32_t states[8][8] = {};
+        size_t lane_blocks = blocks / 8;
+        run("avx2 x8", lane_blocks * 8 * 64, [&] {
+            for (size_t i = 0; i < lane_blocks; i++)
+            {
+                const uint8_t* ptrs[8];
+                for (size_t lane = 0; lane < 8; lane++)
+                    ptrs[lane] = data.data() + (lane * lane_blocks + i) * 64;
+                sha::transform_avx2_x8(states, ptrs);
+            }
+        });
+    }
+
+    // what hash_files actually sees: many header-sized buffers
+    std::vector<std::span<uint8_t>> files;
+    for (size_t off = 0; off + 32768 <= BUFFER_SIZE; off += 32768)
+        files.emplace_back(data.data() + off, 16384 + off % 16384);
+    size_t total = 0;
+    for (const auto& i : files)
+        total += i.size();
+
+    run("digest_str_many", total, [&] { (void)sha::digest_str_many(files); });
+
+    std::printf("(checksum %08x)\n", state[0]);
+}
@@ -0,0 +1,57 @@
+// latency of launching a process with fork() + execve() versus posix_spawn, at a given resident set size
+// build from the repository root with:
+//   clang++ -std=c++20 -O2 -Iapi bench/spawn.cpp meta/utils/process.cpp -o spawn_bench
+// usage: spawn_bench [resident MB, default 1024] [launches, default 200]
+#include "../meta/utils/process.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static pid_t launch_fork(const char* path)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        char* argv[] = {const_cast<char*>(path), nullptr};
+        execve(path, argv, environ);
+        _exit(127);
+    }
+    return pid;
+}
+
+static pid_t launch_spawn(const char* path) { return spawn_process(path, {}, *environment_block::of({})); }
+
+template <typename Fn>
+static void run(const char* name, int launches, Fn&& fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < launches; i++)
+    {
+        int status;
+        waitpid(fn("/bin/true"), &status, 0);
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / launches;
+    std::printf("%-12s %10.1f us/launch\n", name, us);
+}
+
+int main(int argc, char** argv)
+{
+    size_t mb = argc > 1 ? atoi(argv[1]) : 1024;
+    int launches = argc > 2 ? atoi(argv[2]) : 200;
+
+    // touch every page so fork has real page tables to copy
+    auto* ballast = (char*)mmap(nullptr, mb << 20, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    // a real heap is mostly small pages, keep the kernel from backing the ballast with huge ones
+    madvise(ballast, mb << 20, MADV_NOHUGEPAGE);
+    memset(ballast, 1, mb << 20);
+    std::printf("resident ballast: %zu MB\n", mb);
+
+    run("fork+exec", launches, launch_fork);
+    run("posix_spawn", launches, launch_spawn);
+
+    munmap(ballast, mb << 20);
+}
@@ -0,0 +1,77 @@
+// overhead per task of BS::thread_pool versus work_stealing_pool on fine-grained work
+// build from the repository root with:
+//   clang++ -std=c++20 -O2 bench/thread_pool.cpp meta/utils/work_stealing_pool.cpp -o thread_pool_bench
+// usage: thread_pool_bench [threads, default all] [tasks, default 1000000]
+#include "../meta/utils/thread_pool.h"
+#include "../meta/utils/work_stealing_pool.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// a few hundred nanoseconds of work, about what hashing a short path or scanning a depfile line costs
+static uint64_t spin(uint64_t x)
+{
+    for (int i = 0; i < 64; i++)
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+    return x;
+}
+
+static std::atomic<uint64_t> sink;
+
+// every task pushed from the outside, one at a time
+template <typename Pool>
+static void flat(Pool& pool, size_t tasks)
+{
+    for (size_t i = 0; i < tasks; i++)
+        pool.push_task([i]() { sink.fetch_add(spin(i), std::memory_order_relaxed); });
+    pool.wait_for_tasks();
+}
+
+// tasks that push their own subtasks, like a scan that finds more to scan
+template <typename Pool>
+static void fan_out(Pool& pool, size_t tasks)
+{
+    auto node = [&pool](auto& self, size_t lo, size_t hi) -> void {
+        if (hi - lo <= 1)
+        {
+            sink.fetch_add(spin(lo), std::memory_order_relaxed);
+            return;
+        }
+        size_t mid = lo + (hi - lo) / 2;
+        pool.push_task([&self, lo, mid]() { self(self, lo, mid); });
+        pool.push_task([&self, mid, hi]() { self(self, mid, hi); });
+    };
+    pool.push_task([&]() { node(node, 0, tasks); });
+    pool.wait_for_tasks();
+}
+
+template <typename Pool, typename Fn>
+static void run(const char* name, Pool& pool, size_t tasks, Fn&& fn)
+{
+    // warm up once, then take the best of a few runs
+    fn(pool, tasks / 10);
+    double best = 1e30;
+    for (int i = 0; i < 5; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        fn(pool, tasks);
+        best = std::min(best, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::printf("%-28s %10.1f ns/task\n", name, best / tasks);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned threads = argc > 1 ? atoi(argv[1]) : 0;
+    size_t tasks = argc > 2 ? atoll(argv[2]) : 1000000;
+
+    BS::thread_pool bs(threads);
+    work_stealing_pool ws(threads);
+    std::printf("%zu threads, %zu tasks\n", ws.get_thread_count(), tasks);
+
+    run("flat, BS::thread_pool", bs, tasks, [](auto& p, size_t n) { flat(p, n); });
+    run("flat, work_stealing_pool", ws, tasks, [](auto& p, size_t n) { flat(p, n); });
+    run("fan-out, BS::thread_pool", bs, tasks, [](auto& p, size_t n) { fan_out(p, n); });
+    run("fan-out, work_stealing_pool", ws, tasks, [](auto& p, size_t n) { fan_out(p, n); });
+}
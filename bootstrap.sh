@@ -4,8 +4,9 @@ clang++                                 \
     "-I${PWD}/api"                      \
     "-I${PWD}/meta/argparse/include/"   \
     meta/main.cpp                       \
-    meta/impl/*                         \
+    meta/impl/*.cpp                     \
     meta/dl/dl.cpp                      \
+    meta/db/*.cpp                       \
     meta/utils/*.cpp                    \
     -o                                  \
     metabuild                           \
@@ -25,7 +25,8 @@ auto do_build()
 
     for (const auto& i : std::filesystem::recursive_directory_iterator(source_root()))
     {
-        if (i.path().parent_path().filename() == "test" || i.path().parent_path().filename() == "samples")
+        if (i.path().parent_path().filename() == "test" || i.path().parent_path().filename() == "samples" ||
+            i.path().parent_path().filename() == "bench")
             continue;
         if (i.path().extension() != ".cpp")
             continue;
@@ -52,7 +53,8 @@ auto do_build_debug()
 
     for (const auto& i : std::filesystem::recursive_directory_iterator(source_root()))
     {
-        if (i.path().parent_path().filename() == "test" || i.path().parent_path().filename() == "samples")
+        if (i.path().parent_path().filename() == "test" || i.path().parent_path().filename() == "samples" ||
+            i.path().parent_path().filename() == "bench")
             continue;
         if (i.path().extension() != ".cpp")
             continue;
@@ -0,0 +1,373 @@
+#include "build_db.h"
+#include "../state.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <time.h>
+#include <unistd.h>
+
+namespace metabuild
+{
+    inline static constexpr char DB_MAGIC[4] = {'M', 'B', 'D', 'B'};
+    inline static constexpr uint32_t DB_VERSION = 5;
+
+    enum record_type : uint8_t
+    {
+        PUT_ARTIFACT = 1,
+        ERASE_ARTIFACT,
+        PUT_FILE,
+        PUT_OBJECT,
+        ERASE_OBJECT,
+    };
+
+    static void put_u32(std::string& out, uint32_t v) { out.append((const char*)&v, sizeof(v)); }
+    static void put_i64(std::string& out, int64_t v) { out.append((const char*)&v, sizeof(v)); }
+    static void put_str(std::string& out, const std::string& v)
+    {
+        put_u32(out, v.size());
+        out += v;
+    }
+
+    // cursor over a journal; any read past the end marks it bad rather than throwing, since a torn tail is expected after a crash
+    struct db_reader
+    {
+        const char* curr;
+        const char* end;
+        bool ok = true;
+
+        template <typename T>
+        T get()
+        {
+            T v{};
+            if (end - curr < (ptrdiff_t)sizeof(T))
+                ok = false;
+            else
+                memcpy(&v, curr, sizeof(T));
+            curr += ok ? sizeof(T) : 0;
+            return v;
+        }
+
+        std::string get_str()
+        {
+            auto len = get<uint32_t>();
+            if (!ok || end - curr < (ptrdiff_t)len)
+            {
+                ok = false;
+                return {};
+            }
+            std::string v(curr, len);
+            curr += len;
+            return v;
+        }
+    };
+
+    static std::string db_key(const std::filesystem::path& root, const std::filesystem::path& src)
+    {
+        return root.string() + '\0' + src.string();
+    }
+
+    static std::string serialize_put(const std::string& key, const artifact_record& r)
+    {
+        std::string out;
+        out += (char)PUT_ARTIFACT;
+        put_str(out, key);
+        put_str(out, r.artifact_hash);
+        put_str(out, r.flags_hash);
+        out += (char)r.hash_type;
+        put_i64(out, r.source_mtime);
+        put_i64(out, r.build_time);
+        put_i64(out, r.peak_rss);
+        put_i64(out, r.duration_us);
+        put_u32(out, r.deps.size());
+        for (const auto& i : r.deps)
+            put_str(out, i.string());
+        out += (char)r.stale;
+        return out;
+    }
+
+    static std::string serialize_file(const std::string& key, const file_record& r)
+    {
+        std::string out;
+        out += (char)PUT_FILE;
+        put_str(out, key);
+        put_i64(out, r.dev);
+        put_i64(out, r.ino);
+        put_i64(out, r.size);
+        put_i64(out, r.mtime_ns);
+        put_i64(out, r.ctime_ns);
+        put_i64(out, r.recorded_ns);
+        out += (char)r.hash_type;
+        put_str(out, r.hash);
+        return out;
+    }
+
+    static std::string serialize_erase(const std::string& key)
+    {
+        std::string out;
+        out += (char)ERASE_ARTIFACT;
+        put_str(out, key);
+        return out;
+    }
+
+    static std::string serialize_object(const std::string& key, const object_record& r)
+    {
+        std::string out;
+        out += (char)PUT_OBJECT;
+        put_str(out, key);
+        put_i64(out, r.size);
+        put_i64(out, r.last_use_ns);
+        return out;
+    }
+
+    static std::string serialize_erase_object(const std::string& key)
+    {
+        std::string out;
+        out += (char)ERASE_OBJECT;
+        put_str(out, key);
+        return out;
+    }
+
+    static std::string frame(const std::string& record)
+    {
+        std::string out;
+        put_u32(out, record.size());
+        return out + record;
+    }
+
+    static void write_all(int fd, const std::string& buf)
+    {
+        size_t off = 0;
+        while (off < buf.size())
+        {
+            auto n = write(fd, buf.data() + off, buf.size() - off);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                throw std::system_error(errno, std::system_category());
+            off += n;
+        }
+    }
+
+    build_db::build_db()
+    {
+        std::filesystem::create_directories(state_data::get_instance().binary_dir);
+        load(state_data::get_instance().binary_dir / "build.db");
+    }
+
+    build_db::~build_db()
+    {
+        if (journal_fd >= 0)
+            close(journal_fd);
+    }
+
+    void build_db::load(const std::filesystem::path& path)
+    {
+        std::string content;
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0)
+        {
+            char buf[65536];
+            ssize_t n;
+            while ((n = read(fd, buf, sizeof(buf))) != 0)
+            {
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0)
+                    break;
+                content.append(buf, n);
+            }
+            close(fd);
+        }
+
+        size_t record_count = 0;
+        bool valid = content.size() >= 8 && memcmp(content.data(), DB_MAGIC, 4) == 0;
+        db_reader r{content.data() + 4, content.data() + content.size()};
+        valid = valid && r.get<uint32_t>() == DB_VERSION;
+
+        while (valid && r.curr != r.end)
+        {
+            auto len = r.get<uint32_t>();
+            if (!r.ok || r.end - r.curr < (ptrdiff_t)len)
+                break;
+
+            db_reader rec{r.curr, r.curr + len};
+            r.curr += len;
+            record_count++;
+
+            auto type = rec.get<uint8_t>();
+            auto key = rec.get_str();
+
+            if (type == PUT_ARTIFACT)
+            {
+                artifact_record a;
+                a.artifact_hash = rec.get_str();
+                a.flags_hash = rec.get_str();
+                a.hash_type = (content_hash_type)rec.get<uint8_t>();
+                a.source_mtime = rec.get<int64_t>();
+                a.build_time = rec.get<int64_t>();
+                a.peak_rss = rec.get<int64_t>();
+                a.duration_us = rec.get<int64_t>();
+                auto dep_count = rec.get<uint32_t>();
+                for (uint32_t i = 0; i < dep_count && rec.ok; i++)
+                    a.deps.push_back(rec.get_str());
+                a.stale = rec.get<uint8_t>();
+                if (rec.ok)
+                    artifacts[key] = std::move(a);
+            }
+            else if (type == ERASE_ARTIFACT && rec.ok)
+                artifacts.erase(key);
+            else if (type == PUT_FILE)
+            {
+                file_record f;
+                f.dev = rec.get<int64_t>();
+                f.ino = rec.get<int64_t>();
+                f.size = rec.get<int64_t>();
+                f.mtime_ns = rec.get<int64_t>();
+                f.ctime_ns = rec.get<int64_t>();
+                f.recorded_ns = rec.get<int64_t>();
+                f.hash_type = (content_hash_type)rec.get<uint8_t>();
+                f.hash = rec.get_str();
+                if (rec.ok)
+                    files[key] = std::move(f);
+            }
+            else if (type == PUT_OBJECT)
+            {
+                object_record o;
+                o.size = rec.get<int64_t>();
+                o.last_use_ns = rec.get<int64_t>();
+                if (rec.ok)
+                    objects[key] = o;
+            }
+            else if (type == ERASE_OBJECT && rec.ok)
+                objects.erase(key);
+        }
+
+        // rewrite from scratch when the journal is unreadable, torn, or mostly superseded records
+        if (!valid || !r.ok || r.curr != r.end || record_count > 2 * (artifacts.size() + files.size() + objects.size()) + 64)
+            compact(path);
+
+        journal_fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (journal_fd < 0)
+            throw std::system_error(errno, std::system_category());
+    }
+
+    void build_db::compact(const std::filesystem::path& path)
+    {
+        std::string out(DB_MAGIC, 4);
+        put_u32(out, DB_VERSION);
+        for (const auto& [key, record] : artifacts)
+            out += frame(serialize_put(key, record));
+        for (const auto& [key, record] : files)
+            out += frame(serialize_file(key, record));
+        for (const auto& [key, record] : objects)
+            out += frame(serialize_object(key, record));
+
+        auto tmp = path;
+        tmp += ".tmp";
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+            throw std::system_error(errno, std::system_category());
+        write_all(fd, out);
+        close(fd);
+        std::filesystem::rename(tmp, path);
+    }
+
+    void build_db::append(const std::string& record)
+    {
+        // a single write on an O_APPEND descriptor, so records are never interleaved
+        write_all(journal_fd, frame(record));
+    }
+
+    std::optional<artifact_record> build_db::get_artifact(const std::filesystem::path& root, const std::filesystem::path& src)
+    {
+        std::lock_guard g(mtx);
+        auto it = artifacts.find(db_key(root, src));
+        if (it == artifacts.end())
+            return std::nullopt;
+        return it->second;
+    }
+
+    void build_db::put_artifact(const std::filesystem::path& root, const std::filesystem::path& src, const artifact_record& record)
+    {
+        auto key = db_key(root, src);
+        std::lock_guard g(mtx);
+        append(serialize_put(key, record));
+        artifacts[key] = record;
+    }
+
+    void build_db::erase_artifact(const std::filesystem::path& root, const std::filesystem::path& src)
+    {
+        auto key = db_key(root, src);
+        std::lock_guard g(mtx);
+        if (artifacts.erase(key))
+            append(serialize_erase(key));
+    }
+
+    void build_db::erase_artifacts(const std::filesystem::path& root)
+    {
+        auto prefix = db_key(root, "");
+        std::lock_guard g(mtx);
+        for (auto it = artifacts.begin(); it != artifacts.end();)
+        {
+            if (it->first.starts_with(prefix))
+            {
+                append(serialize_erase(it->first));
+                it = artifacts.erase(it);
+            }
+            else
+                it++;
+        }
+    }
+
+    void build_db::put_object(const std::string& name, const object_record& record)
+    {
+        std::lock_guard g(mtx);
+        append(serialize_object(name, record));
+        objects[name] = record;
+    }
+
+    void build_db::erase_object(const std::string& name)
+    {
+        std::lock_guard g(mtx);
+        if (objects.erase(name))
+            append(serialize_erase_object(name));
+    }
+
+    std::vector<std::pair<std::string, object_record>> build_db::get_objects()
+    {
+        std::lock_guard g(mtx);
+        return {objects.begin(), objects.end()};
+    }
+
+    std::optional<file_record> build_db::get_file(const std::filesystem::path& path)
+    {
+        std::lock_guard g(mtx);
+        auto it = files.find(path.string());
+        if (it == files.end())
+            return std::nullopt;
+        return it->second;
+    }
+
+    void build_db::put_file(const std::filesystem::path& path, const file_record& record)
+    {
+        std::lock_guard g(mtx);
+        append(serialize_file(path.string(), record));
+        files[path.string()] = record;
+    }
+
+    int64_t file_mtime_ns(const std::filesystem::path& path)
+    {
+        struct stat s;
+        if (stat(path.c_str(), &s) < 0)
+            return 0;
+        return (int64_t)s.st_mtim.tv_sec * 1000000000 + s.st_mtim.tv_nsec;
+    }
+
+    int64_t now_ns()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+} // namespace metabuild
@@ -0,0 +1,91 @@
+#pragma once
+#include "../singleton.h"
+#include <build_config.h>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace metabuild
+{
+    // what we know about the object currently built from a source
+    struct artifact_record
+    {
+        std::string artifact_hash;
+        std::string flags_hash;
+        content_hash_type hash_type = HASH_SHA256;
+        int64_t source_mtime = 0;
+        int64_t build_time = 0;
+        // peak resident set of the compiler in kilobytes, what the next compile of this source is expected to need
+        int64_t peak_rss = 0;
+        // wall time of that compile in microseconds, how long the next one is expected to take
+        int64_t duration_us = 0;
+        std::vector<std::filesystem::path> deps;
+        // set when the inputs changed during the compile, forcing the next lookup to miss
+        bool stale = false;
+    };
+
+    // the stat identity of an input along with the content hash computed for it
+    struct file_record
+    {
+        uint64_t dev = 0;
+        uint64_t ino = 0;
+        int64_t size = 0;
+        int64_t mtime_ns = 0;
+        int64_t ctime_ns = 0;
+        // when the content was read, used to detect racily clean entries
+        int64_t recorded_ns = 0;
+        content_hash_type hash_type = HASH_SHA256;
+        std::string hash;
+    };
+
+    // an entry of the object store, see object_store.h
+    struct object_record
+    {
+        int64_t size = 0;
+        // when a build last produced or reused it, eviction goes least recently used first
+        int64_t last_use_ns = 0;
+    };
+
+    // persistent, append-only database living at binary_root()/build.db
+    // lookups are answered from memory, every update is appended to the journal so it survives fatal() and crashes
+    class build_db : public singleton<build_db>
+    {
+        std::mutex mtx;
+        std::unordered_map<std::string, artifact_record> artifacts;
+        std::unordered_map<std::string, file_record> files;
+        std::unordered_map<std::string, object_record> objects;
+        int journal_fd = -1;
+
+        void load(const std::filesystem::path& path);
+        void compact(const std::filesystem::path& path);
+        void append(const std::string& record);
+
+    protected:
+        build_db();
+
+    public:
+        ~build_db();
+
+        std::optional<artifact_record> get_artifact(const std::filesystem::path& root, const std::filesystem::path& src);
+        void put_artifact(const std::filesystem::path& root, const std::filesystem::path& src, const artifact_record& record);
+        void erase_artifact(const std::filesystem::path& root, const std::filesystem::path& src);
+        // every artifact recorded under root
+        void erase_artifacts(const std::filesystem::path& root);
+
+        // keyed by the path of the object relative to the store
+        void put_object(const std::string& name, const object_record& record);
+        void erase_object(const std::string& name);
+        std::vector<std::pair<std::string, object_record>> get_objects();
+
+        std::optional<file_record> get_file(const std::filesystem::path& path);
+        void put_file(const std::filesystem::path& path, const file_record& record);
+    };
+
+    int64_t file_mtime_ns(const std::filesystem::path& path);
+    int64_t now_ns();
+} // namespace metabuild
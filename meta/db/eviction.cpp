@@ -0,0 +1,65 @@
+#include "eviction.h"
+#include "build_db.h"
+#include <core.h>
+#include <algorithm>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace metabuild
+{
+    void touch_variant(const std::filesystem::path& variant)
+    {
+        // the directory mtime is the last use, adding or removing objects only ever moves it forward as well
+        std::filesystem::create_directories(variant);
+        std::filesystem::last_write_time(variant, std::filesystem::file_time_type::clock::now());
+    }
+
+    void evict_variants(const std::filesystem::path& root, size_t keep)
+    {
+        std::error_code ec;
+        std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> variants;
+        for (const auto& i : std::filesystem::directory_iterator(root, ec))
+        {
+            if (i.is_directory(ec))
+                variants.emplace_back(i.last_write_time(ec), i.path());
+            else
+                // objects from before the object store were kept in here
+                std::filesystem::remove(i.path(), ec);
+        }
+
+        if (variants.size() <= keep)
+            return;
+
+        std::sort(variants.begin(), variants.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+        for (size_t i = keep; i < variants.size(); i++)
+        {
+            build_db::get_instance().erase_artifacts(variants[i].second);
+            std::filesystem::remove_all(variants[i].second, ec);
+        }
+    }
+
+    void evict_objects(uint64_t limit, int64_t keep_since_ns)
+    {
+        auto& db = build_db::get_instance();
+        auto objects = db.get_objects();
+
+        uint64_t total = 0;
+        for (const auto& i : objects)
+            total += i.second.size;
+        if (total <= limit)
+            return;
+
+        std::sort(objects.begin(), objects.end(), [](const auto& a, const auto& b) { return a.second.last_use_ns < b.second.last_use_ns; });
+        auto root = binary_root() / "objects";
+        for (const auto& [name, record] : objects)
+        {
+            if (total <= limit || record.last_use_ns >= keep_since_ns)
+                break;
+            std::error_code ec;
+            std::filesystem::remove(root / name, ec);
+            db.erase_object(name);
+            total -= record.size;
+        }
+    }
+} // namespace metabuild
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+namespace metabuild
+{
+    // marks a variant directory as used by the current build, creating it if needed
+    void touch_variant(const std::filesystem::path& variant);
+
+    // keeps the keep most recently used variant directories under root and forgets the others, database entries and directory alike;
+    // their objects are left to evict_objects
+    void evict_variants(const std::filesystem::path& root, size_t keep);
+
+    // removes the least recently used objects from the object store until it fits in limit bytes; objects used at or after keep_since_ns
+    // stay regardless, they belong to the build that just ran
+    void evict_objects(uint64_t limit, int64_t keep_since_ns);
+} // namespace metabuild
@@ -0,0 +1,186 @@
+#include "file_hash.h"
+#include "../utils/content_hash.h"
+#include "../utils/mmap.h"
+#include "build_db.h"
+#include <future>
+#include <memory>
+#include <shared_mutex>
+#include <sys/stat.h>
+#include <system_error>
+#include <unordered_map>
+
+namespace metabuild
+{
+    // file timestamps come from a coarse clock (and whole seconds on some filesystems), so a write landing shortly after we read a file
+    // can leave its stat unchanged; like git's racy-clean check, we do not trust entries modified this close to when they were hashed
+    inline static constexpr int64_t RACY_WINDOW_NS = 1000000000;
+
+    inline static constexpr size_t MEMO_SHARDS = 64;
+
+    static bool same_identity(const file_record& a, const file_record& b)
+    {
+        return a.dev == b.dev && a.ino == b.ino && a.size == b.size && a.mtime_ns == b.mtime_ns && a.ctime_ns == b.ctime_ns &&
+               a.hash_type == b.hash_type;
+    }
+
+    static bool is_racy(const file_record& r) { return std::max(r.mtime_ns, r.ctime_ns) + RACY_WINDOW_NS >= r.recorded_ns; }
+
+    // process-wide memo in front of the build database, so a file shared between targets is read and hashed at most once per run
+    // entries are keyed by (dev, inode), which is what every path spelling of a file resolves to, and validated against the rest of
+    // the stat identity; an entry still being hashed holds the future its result will arrive through
+    struct memo_entry
+    {
+        file_record identity;
+        std::shared_future<std::string> hash;
+    };
+
+    struct memo_key
+    {
+        uint64_t dev;
+        uint64_t ino;
+
+        bool operator==(const memo_key&) const = default;
+    };
+
+    struct memo_key_hash
+    {
+        size_t operator()(const memo_key& k) const { return std::hash<uint64_t>{}(k.ino * 31 + k.dev); }
+    };
+
+    // sharded so the parallel compiles mostly take uncontended shared locks
+    struct memo_shard
+    {
+        std::shared_mutex mtx;
+        std::unordered_map<memo_key, memo_entry, memo_key_hash> entries;
+    };
+
+    static memo_shard& shard_for(const memo_key& k)
+    {
+        static memo_shard shards[MEMO_SHARDS];
+        return shards[memo_key_hash{}(k) % MEMO_SHARDS];
+    }
+
+    std::optional<std::string> hash_file(const std::filesystem::path& path) { return hash_files({path})[0]; }
+
+    std::vector<std::optional<std::string>> hash_files(const std::vector<std::filesystem::path>& paths)
+    {
+        auto& db = build_db::get_instance();
+        auto hash_type = get_build_config().content_hash;
+        std::vector<std::optional<std::string>> out(paths.size());
+
+        // files someone else is already hashing, and the ones we claimed for ourselves
+        std::vector<std::pair<size_t, std::shared_future<std::string>>> pending;
+        std::vector<size_t> misses;
+        std::vector<file_record> miss_records;
+        std::vector<std::promise<std::string>> promises;
+
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            struct stat st;
+            if (stat(paths[i].c_str(), &st) < 0)
+            {
+                if (errno == ENOENT || errno == ENOTDIR)
+                    continue;
+                throw std::system_error(errno, std::system_category());
+            }
+
+            file_record curr;
+            curr.dev = st.st_dev;
+            curr.ino = st.st_ino;
+            curr.size = st.st_size;
+            curr.mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+            curr.ctime_ns = (int64_t)st.st_ctim.tv_sec * 1000000000 + st.st_ctim.tv_nsec;
+            curr.hash_type = hash_type;
+
+            memo_key key{curr.dev, curr.ino};
+            auto& shard = shard_for(key);
+
+            {
+                std::shared_lock g(shard.mtx);
+                auto it = shard.entries.find(key);
+                if (it != shard.entries.end() && same_identity(it->second.identity, curr))
+                {
+                    pending.emplace_back(i, it->second.hash);
+                    continue;
+                }
+            }
+
+            // the memo only ever holds results from this run, the database is what survives between runs
+            auto record = db.get_file(paths[i]);
+            bool trusted = record && same_identity(record.value(), curr) && !is_racy(record.value());
+
+            std::unique_lock g(shard.mtx);
+            auto it = shard.entries.find(key);
+            if (it != shard.entries.end() && same_identity(it->second.identity, curr))
+            {
+                // lost the race to another thread
+                pending.emplace_back(i, it->second.hash);
+                continue;
+            }
+
+            if (trusted)
+            {
+                std::promise<std::string> p;
+                p.set_value(record->hash);
+                shard.entries[key] = {record.value(), p.get_future().share()};
+                out[i] = record->hash;
+                continue;
+            }
+
+            promises.emplace_back();
+            shard.entries[key] = {curr, promises.back().get_future().share()};
+            misses.push_back(i);
+            miss_records.push_back(curr);
+        }
+
+        if (!misses.empty())
+        {
+            try
+            {
+                // the stat is taken before reading, so a write during the read shows up as a changed identity next time
+                auto recorded_ns = now_ns();
+                std::vector<std::unique_ptr<mmap_file>> files;
+                std::vector<std::span<uint8_t>> bufs;
+                for (auto i : misses)
+                {
+                    files.push_back(std::make_unique<mmap_file>(paths[i]));
+                    bufs.push_back(files.back()->buffer());
+                }
+
+                auto digests = content_hasher::digest_str_many(hash_type, bufs);
+                for (size_t i = 0; i < misses.size(); i++)
+                {
+                    miss_records[i].recorded_ns = recorded_ns;
+                    miss_records[i].hash = digests[i];
+                    db.put_file(paths[misses[i]], miss_records[i]);
+                    promises[i].set_value(digests[i]);
+                    out[misses[i]] = digests[i];
+                }
+            }
+            catch (...)
+            {
+                // drop our claims so later lookups retry rather than inheriting the failure forever
+                for (size_t i = 0; i < misses.size(); i++)
+                {
+                    memo_key key{miss_records[i].dev, miss_records[i].ino};
+                    auto& shard = shard_for(key);
+                    std::unique_lock g(shard.mtx);
+                    shard.entries.erase(key);
+                    try
+                    {
+                        promises[i].set_exception(std::current_exception());
+                    }
+                    catch (const std::future_error&)
+                    {
+                    }
+                }
+                throw;
+            }
+        }
+
+        for (auto& [i, hash] : pending)
+            out[i] = hash.get();
+
+        return out;
+    }
+} // namespace metabuild
@@ -0,0 +1,15 @@
+#pragma once
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace metabuild
+{
+    // content hash of a file, reusing the hash recorded in the build database when the file's stat identity is unchanged
+    // returns nullopt if the file does not exist
+    std::optional<std::string> hash_file(const std::filesystem::path& path);
+
+    // same as hash_file, but every file that does need reading is hashed in one batch
+    std::vector<std::optional<std::string>> hash_files(const std::vector<std::filesystem::path>& paths);
+} // namespace metabuild
@@ -0,0 +1,24 @@
+#include "object_store.h"
+#include "build_db.h"
+#include <core.h>
+
+namespace metabuild
+{
+    std::filesystem::path object_path(const std::string& hash, const std::string& extension)
+    {
+        return binary_root() / "objects" / hash.substr(0, 2) / (hash.substr(2) + extension);
+    }
+
+    void publish_object(const std::filesystem::path& tmp_path, const std::filesystem::path& path)
+    {
+        std::filesystem::create_directories(path.parent_path());
+        std::filesystem::rename(tmp_path, path);
+        use_object(path);
+    }
+
+    void use_object(const std::filesystem::path& path)
+    {
+        auto name = path.lexically_relative(binary_root() / "objects").string();
+        build_db::get_instance().put_object(name, {(int64_t)std::filesystem::file_size(path), now_ns()});
+    }
+} // namespace metabuild
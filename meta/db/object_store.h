@@ -0,0 +1,17 @@
+#pragma once
+#include <filesystem>
+#include <string>
+
+namespace metabuild
+{
+    // content addressed storage for build outputs under binary_root()/objects: the output keyed by hash lives at
+    // objects/<first two hex digits>/<the rest><extension>, so no directory grows past a few thousand entries, and identical outputs of
+    // different targets or configurations are stored once
+    std::filesystem::path object_path(const std::string& hash, const std::string& extension = "");
+
+    // moves a finished output into the store at path, creating its shard
+    void publish_object(const std::filesystem::path& tmp_path, const std::filesystem::path& path);
+
+    // records that the current build produced or reused the object at path, which is what eviction orders by
+    void use_object(const std::filesystem::path& path);
+} // namespace metabuild
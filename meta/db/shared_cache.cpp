@@ -0,0 +1,134 @@
+#include "shared_cache.h"
+#include "object_store.h"
+#include <atomic>
+#include <boost/algorithm/string/replace.hpp>
+#include <build_config.h>
+#include <core.h>
+#include <fstream>
+#include <system_error>
+#include <unistd.h>
+
+namespace metabuild
+{
+    inline static constexpr const char* SOURCE_ROOT_PLACEHOLDER = "$SOURCE_ROOT";
+
+    // whatever the umask: directories are group-writable and setgid, so every shard keeps the cache's group, and entries are
+    // group-writable, so anyone in that group can publish next to and over them
+    inline static constexpr auto DIRECTORY_PERMS = std::filesystem::perms::set_gid | std::filesystem::perms::owner_all |
+                                                  std::filesystem::perms::group_all | std::filesystem::perms::others_read |
+                                                  std::filesystem::perms::others_exec;
+    inline static constexpr auto ENTRY_PERMS = std::filesystem::perms::owner_read | std::filesystem::perms::owner_write |
+                                              std::filesystem::perms::group_read | std::filesystem::perms::group_write |
+                                              std::filesystem::perms::others_read;
+
+    // like create_directories, but whatever we create gets DIRECTORY_PERMS
+    static void create_shared_directories(const std::filesystem::path& path)
+    {
+        if (std::filesystem::is_directory(path) || !path.has_relative_path())
+            return;
+        create_shared_directories(path.parent_path());
+
+        std::error_code ec;
+        if (std::filesystem::create_directory(path, ec))
+            std::filesystem::permissions(path, DIRECTORY_PERMS);
+        else if (!std::filesystem::is_directory(path))
+            throw std::filesystem::filesystem_error("cannot create directory", path, ec);
+    }
+
+    static std::filesystem::path entry_path(const std::filesystem::path& dir, const std::string& key, const std::string& extension = "")
+    {
+        return dir / key.substr(0, 2) / (key.substr(2) + extension);
+    }
+
+    // unique across processes and threads, so concurrent writers never share a temporary
+    static std::filesystem::path unique_tmp(const std::filesystem::path& path)
+    {
+        static std::atomic<uint64_t> counter = 0;
+        return path.string() + "." + std::to_string(getpid()) + "." + std::to_string(counter++) + ".tmp";
+    }
+
+    shared_cache::shared_cache() : dir(get_build_config().shared_cache)
+    {
+        if (!enabled())
+            return;
+        create_shared_directories(dir / "objects");
+        create_shared_directories(dir / "manifests");
+    }
+
+    std::filesystem::path shared_cache::root()
+    {
+        auto root = source_root();
+        return root.has_filename() ? root : root.parent_path();
+    }
+
+    std::string shared_cache::portable(const std::string& str) const
+    {
+        std::string out = str;
+        boost::replace_all(out, root().string(), SOURCE_ROOT_PLACEHOLDER);
+        return out;
+    }
+
+    std::filesystem::path shared_cache::local(const std::string& str) const
+    {
+        std::string out = str;
+        boost::replace_all(out, SOURCE_ROOT_PLACEHOLDER, root().string());
+        return out;
+    }
+
+    std::optional<std::vector<std::filesystem::path>> shared_cache::get_manifest(const std::string& key) const
+    {
+        std::ifstream in(entry_path(dir / "manifests", key));
+        if (!in)
+            return std::nullopt;
+
+        std::vector<std::filesystem::path> deps;
+        std::string line;
+        while (std::getline(in, line))
+            deps.push_back(local(line));
+        return deps;
+    }
+
+    void shared_cache::put_manifest(const std::string& key, const std::vector<std::filesystem::path>& deps) const
+    {
+        auto path = entry_path(dir / "manifests", key);
+        auto tmp = unique_tmp(path);
+        create_shared_directories(path.parent_path());
+        {
+            std::ofstream out(tmp);
+            for (const auto& i : deps)
+                out << portable(i.string()) << '\n';
+            if (!out.flush())
+                throw std::system_error(errno, std::system_category());
+        }
+        std::filesystem::permissions(tmp, ENTRY_PERMS);
+        std::filesystem::rename(tmp, path);
+    }
+
+    bool shared_cache::fetch(const std::string& key, const std::filesystem::path& dest) const
+    {
+        // a copy rather than a link, the entry may belong to another user or live on another filesystem
+        auto tmp = unique_tmp(dest);
+        std::filesystem::create_directories(dest.parent_path());
+        std::error_code ec;
+        if (!std::filesystem::copy_file(entry_path(dir / "objects", key, ".o"), tmp, ec))
+        {
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+        publish_object(tmp, dest);
+        return true;
+    }
+
+    void shared_cache::publish(const std::string& key, const std::filesystem::path& src) const
+    {
+        auto path = entry_path(dir / "objects", key, ".o");
+        if (std::filesystem::exists(path))
+            return;
+
+        auto tmp = unique_tmp(path);
+        create_shared_directories(path.parent_path());
+        std::filesystem::copy_file(src, tmp);
+        std::filesystem::permissions(tmp, ENTRY_PERMS);
+        std::filesystem::rename(tmp, path);
+    }
+} // namespace metabuild
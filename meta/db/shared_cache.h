@@ -0,0 +1,42 @@
+#pragma once
+#include "../singleton.h"
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace metabuild
+{
+    // a compile cache shared by every checkout and user on the machine, at build_config::shared_cache
+    //   objects/ab/cdef....o  objects keyed by a hash that only covers what is the same in every checkout: the compiler binary, flags and
+    //                         paths with the source root replaced, and the content of the source and its headers
+    //   manifests/ab/cdef...  the headers the source included last time, keyed by the same hash without the headers, since a checkout that
+    //                         never compiled the source cannot know them
+    // nothing is ever locked: entries are written under a unique temporary name and renamed into place, so readers see a whole entry or none,
+    // and when two processes publish the same key both entries are equally good
+    // to share it between users, make them members of the directory's group: directories are created group-writable and setgid, entries
+    // group-writable, whatever the umask. nothing bounds its size, nor evicts from it; prune it from outside, e.g. by access time
+    class shared_cache : public singleton<shared_cache>
+    {
+        std::filesystem::path dir;
+
+    protected:
+        shared_cache();
+
+    public:
+        bool enabled() const { return !dir.empty(); }
+
+        // source_root() without the trailing separator normalize_path leaves on a root given as "."
+        static std::filesystem::path root();
+        // the same string in every checkout: root() becomes a placeholder
+        std::string portable(const std::string& str) const;
+        std::filesystem::path local(const std::string& str) const;
+
+        std::optional<std::vector<std::filesystem::path>> get_manifest(const std::string& key) const;
+        void put_manifest(const std::string& key, const std::vector<std::filesystem::path>& deps) const;
+
+        // copies the object for key to dest, false if the cache does not have it
+        bool fetch(const std::string& key, const std::filesystem::path& dest) const;
+        void publish(const std::string& key, const std::filesystem::path& src) const;
+    };
+} // namespace metabuild
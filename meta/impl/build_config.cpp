@@ -1,3 +1,4 @@
+#include "../state.h"
 #include "core.h"
 #include <build_config.h>
 
@@ -6,7 +7,10 @@ namespace metabuild
     METABUILD_PUBLIC const build_config& get_build_config()
     {
         static build_config c{
-            build_type::DEBUG
+            build_type::DEBUG,
+            state_data::get_instance().content_hash,
+            state_data::get_instance().object_store_limit,
+            state_data::get_instance().shared_cache,
         };
         return c;
     }
@@ -0,0 +1,209 @@
+#include "../db/build_db.h"
+#include "../db/eviction.h"
+#include "compile_job.h"
+#include "compiler.h"
+#include "link_job.h"
+#include "linker.h"
+#include "log.h"
+#include "scheduler.h"
+#include <build_graph.h>
+#include <chrono>
+#include <filesystem>
+#include <fmt/format.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace metabuild
+{
+    // configurations of a target whose variant directories are kept around, c and c++ counting separately; a variant only holds database
+    // entries and temporaries, the objects themselves live in the store
+    inline static constexpr size_t KEPT_VARIANTS = 8;
+
+    static std::string describe_usage(const resource_usage& usage)
+    {
+        auto seconds = [](std::chrono::microseconds t) { return std::chrono::duration<double>(t).count(); };
+        return fmt::format("{:.2f}s user, {:.2f}s sys, {:.2f}s wall, {} MiB peak rss, {} major faults", seconds(usage.user_time),
+                           seconds(usage.system_time), seconds(usage.wall_time), usage.max_rss / 1024, usage.major_faults);
+    }
+
+    // what the compiles of one target hand to its link
+    struct target_state
+    {
+        std::mutex mtx;
+        // one slot per source, c sources then c++ sources, each in declaration order, whatever order the compiles finish in, so the same
+        // objects always give the linker the same command line and the same binary
+        std::vector<std::filesystem::path> objects;
+        resource_usage usage;
+        size_t compiled = 0;
+    };
+
+    static size_t add_compile(build_scheduler& sched, target_state& state, size_t slot, const compiler& c, const std::filesystem::path& in,
+                              const compiler_flags& flags, const std::filesystem::path& obj_root, bool quiet)
+    {
+        // prepare and finish of one compile share the job
+        auto job = std::make_shared<std::optional<compile_job>>();
+
+        auto prepare = [&c, in, &flags, obj_root, job, &state, slot, quiet]() -> std::optional<process_request> {
+            if (!quiet)
+                info("compiling " + in.string());
+            auto prepared = compile_job::prepare(c, in, flags, obj_root);
+            if (!prepared)
+                throw metabuild_error(error_code::BUILD_FAILED, "compile error: \n" + prepared.error());
+            if (prepared->cached)
+            {
+                std::lock_guard g(state.mtx);
+                state.objects[slot] = prepared->cached.value();
+                return std::nullopt;
+            }
+
+            job->emplace(std::move(prepared.value()));
+            return std::move(job->value().request);
+        };
+
+        auto finish = [in, job, &state, slot](const process_output* result) {
+            // cached, already recorded
+            if (!result)
+                return;
+            if (result->cancelled)
+                return job->value().abandon();
+
+            debug(in.string() + ": " + describe_usage(result->status.get_usage()));
+            {
+                std::lock_guard g(state.mtx);
+                state.usage += result->status.get_usage();
+                state.compiled++;
+            }
+
+            if (result->status != 0)
+            {
+                job->value().abandon();
+                throw metabuild_error(error_code::BUILD_FAILED, "failed to compile " + in.string());
+            }
+
+            auto compile_out = job->value().finish(*result);
+            if (!compile_out)
+                throw metabuild_error(error_code::BUILD_FAILED, "compile error: \n" + compile_out.error());
+            std::lock_guard g(state.mtx);
+            state.objects[slot] = compile_out.value().first;
+        };
+
+        return sched.add(std::move(prepare), std::move(finish));
+    }
+
+    static size_t add_link(build_scheduler& sched, target_state& state, const std::string& name, const linker_flags& flags, bool quiet)
+    {
+        auto job = std::make_shared<link_job>();
+
+        auto prepare = [&state, &name, &flags, job, quiet]() -> std::optional<process_request> {
+            // every compile of the target has finished by now
+            if (state.compiled && !quiet)
+                info(fmt::format("{}: {} compiles: {}", name, state.compiled, describe_usage(state.usage)));
+
+            auto prepared = link_job::prepare(system_linker(), name, state.objects, flags);
+            if (!prepared)
+                throw metabuild_error(error_code::BUILD_FAILED, "linker error: \n" + prepared.error());
+            *job = std::move(prepared.value());
+
+            if (job->cached)
+            {
+                bool restored = job->install();
+                if (!quiet)
+                    info("linking " + name + (restored ? " (restored from cache)" : " (skipped)"));
+                return std::nullopt;
+            }
+
+            if (!quiet)
+                info("linking " + name);
+            return std::move(job->request);
+        };
+
+        auto finish = [&name, job](const process_output* result) {
+            if (result && result->cancelled)
+                job->abandon();
+            if (!result || result->cancelled)
+                return;
+            auto link_result = job->finish(*result);
+            if (!link_result)
+                throw metabuild_error(error_code::BUILD_FAILED, "failed to link " + name + ": \n" + link_result.error());
+        };
+
+        // the linker is run verbosely, its output is only worth showing when it fails
+        return sched.add(std::move(prepare), std::move(finish), false);
+    }
+
+    METABUILD_PUBLIC std::vector<command> build_graph::build(bool quiet) const
+    {
+        build_scheduler sched;
+        std::vector<target_state> states(targets.size());
+
+        // compiles are weighted by how long they took last time; a source never built before counts as an average one
+        std::chrono::microseconds known_cost{0};
+        size_t known = 0;
+        std::vector<size_t> unknown;
+        auto estimate = [&](size_t node, const compiler& c, const std::filesystem::path& src, const compiler_flags& flags,
+                            const std::filesystem::path& obj_root) {
+            auto cost = compile_job::last_duration(c, src, flags, obj_root);
+            if (!cost)
+                return unknown.push_back(node);
+            sched.set_cost(node, cost.value());
+            known_cost += cost.value();
+            known++;
+        };
+
+        for (size_t i = 0; i < targets.size(); i++)
+        {
+            const auto& target = *targets[i];
+            auto obj_root = binary_root() / "executable" / target.name / "obj";
+
+            // the configurations built now are the newest, whatever gets evicted it is not them
+            touch_variant(compile_job::variant_root(system_compiler_c(), target.cc_flags, obj_root));
+            touch_variant(compile_job::variant_root(system_compiler_cpp(), target.cxx_flags, obj_root));
+            evict_variants(obj_root, KEPT_VARIANTS);
+
+            std::vector<size_t> compiles;
+            states[i].objects.resize(target.c_src.size() + target.cxx_src.size());
+            for (const auto& src : target.c_src)
+            {
+                compiles.push_back(add_compile(sched, states[i], compiles.size(), system_compiler_c(), src, target.cc_flags, obj_root, quiet));
+                estimate(compiles.back(), system_compiler_c(), src, target.cc_flags, obj_root);
+            }
+            for (const auto& src : target.cxx_src)
+            {
+                compiles.push_back(add_compile(sched, states[i], compiles.size(), system_compiler_cpp(), src, target.cxx_flags, obj_root, quiet));
+                estimate(compiles.back(), system_compiler_cpp(), src, target.cxx_flags, obj_root);
+            }
+
+            auto link = add_link(sched, states[i], target.name, target.ld_flags, quiet);
+            for (auto compile : compiles)
+                sched.depend(link, compile);
+        }
+
+        if (known)
+        {
+            for (auto node : unknown)
+                sched.set_cost(node, known_cost / known);
+        }
+
+        // whatever this build used is newer than started, so eviction never takes it, failed or not
+        auto started = now_ns();
+        auto evict = [started]() { evict_objects((uint64_t)get_build_config().object_store_limit << 20, started); };
+        try
+        {
+            sched.run({.threads = use_threads, .memory_budget = mem_budget, .keep_going = continue_on_error, .quiet = quiet});
+        }
+        catch (...)
+        {
+            evict();
+            throw;
+        }
+        evict();
+
+        std::vector<command> commands;
+        for (auto target : targets)
+            commands.emplace_back(binary_root() / "link" / target->name);
+        return commands;
+    }
+} // namespace metabuild
@@ -1,67 +1,68 @@
+#include "../utils/process.h"
+#include <chrono>
 #include <command.h>
 #include <filesystem>
 #include <memory>
 #include <utils.h>
 
-#include <signal.h>
 #include <cstring>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/types.h>
-#include <sys/wait.h>
 #include <system_error>
 #include <unistd.h>
 
 namespace metabuild
 {
-    [[noreturn]] static void do_exec(const std::filesystem::path& name, const program_arguments& args, const program_environment& env)
+    inline static constexpr size_t PIPE_READ_SIZE = 64 * 1024;
+
+    // reads both pipes until each reaches eof, in whichever order the data shows up
+    static void drain_pipes(int out_fd, std::string& out, int err_fd, std::string& err)
     {
-        // set up argv
-        std::string a0 = name.string();
-        std::vector<char*> argv;
-        argv.push_back(const_cast<char*>(a0.c_str()));
-        for (size_t i = 0; i < args.size(); i++)
-            argv.push_back(const_cast<char*>(args[i].c_str()));
-        argv.push_back(nullptr);
-
-        // set up envp
-        std::vector<char*> envp;
-
-        // copy current environ
-        auto curr_env = environ;
-        while (*curr_env)
-            envp.push_back(*curr_env++);
-
-        // add the other stuff
-        for (const auto& i : env)
+        std::unique_ptr<char[]> buf(new char[PIPE_READ_SIZE]);
+        pollfd fds[2] = {{out_fd, POLLIN, 0}, {err_fd, POLLIN, 0}};
+        std::string* sinks[2] = {&out, &err};
+        int open_fds = 2;
+
+        while (open_fds)
         {
-            std::string res = i.first + "=" + i.second;
-            envp.push_back(strcpy(new char[res.size() + 1], res.c_str()));
-        }
+            if (poll(fds, 2, -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::system_category());
+            }
+
+            for (int i = 0; i < 2; i++)
+            {
+                if (fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                    continue;
 
-        envp.push_back(nullptr);
+                auto bytes_read = read(fds[i].fd, buf.get(), PIPE_READ_SIZE);
+                if (bytes_read < 0 && errno == EINTR)
+                    continue;
+                if (bytes_read < 0)
+                    throw std::system_error(errno, std::system_category());
 
-        execve(a0.c_str(), argv.data(), envp.data());
-        exit(-1);
+                if (bytes_read == 0)
+                {
+                    // a negative fd is ignored by poll
+                    fds[i].fd = -1;
+                    open_fds--;
+                }
+                else
+                    sinks[i]->append(buf.get(), bytes_read);
+            }
+        }
     }
 
     METABUILD_PUBLIC lazy<program_result> command::invoke_async(const program_arguments& args, const program_environment& env) const
     {
-        pid_t child_pid = fork();
-
-        if (child_pid == -1)
-            throw std::system_error(errno, std::system_category());
-        else if (child_pid == 0)
-            do_exec(name, args, env);
+        auto started = std::chrono::steady_clock::now();
+        pid_t child_pid = spawn_process(name, args, *environment_block::of(env));
 
-        return [child_pid]() -> program_result {
-            int status;
-            while (waitpid(child_pid, &status, WUNTRACED) == -1)
-            {
-                if (errno != EINTR)
-                    throw std::system_error(errno, std::system_category());
-            }
-            return status;
-        };
+        return [child_pid, started]() -> program_result { return reap_process(child_pid, started).value(); };
     }
 
     METABUILD_PUBLIC program_result command::invoke(const program_arguments& args, const program_environment& env, std::string& out, std::string& err) const
@@ -69,54 +70,45 @@ namespace metabuild
         int pipe_stdout[2];
         int pipe_stderr[2];
 
-        if (pipe(pipe_stdout) < 0)
+        // close-on-exec, so children spawned concurrently from other threads never inherit (and hold open) our pipes
+        if (pipe2(pipe_stdout, O_CLOEXEC) < 0)
             throw std::system_error(errno, std::system_category());
-        if (pipe(pipe_stderr) < 0)
+        if (pipe2(pipe_stderr, O_CLOEXEC) < 0)
             throw std::system_error(errno, std::system_category());
 
-        pid_t child_pid = fork();
-
-        if (child_pid == -1)
-            throw std::system_error(errno, std::system_category());
-        else if (child_pid == 0)
+        auto started = std::chrono::steady_clock::now();
+        pid_t child_pid;
+        try
         {
-            close(pipe_stdout[0]);
-            close(pipe_stderr[0]);
-            dup2(pipe_stdout[1], 1);
-            dup2(pipe_stderr[1], 2);
-
-            do_exec(name, args, env);
+            child_pid = spawn_process(name, args, *environment_block::of(env), pipe_stdout[1], pipe_stderr[1]);
         }
-
-        int status = 0;
-        while (waitpid(child_pid, &status, WUNTRACED) == -1)
+        catch (...)
         {
-            if (errno != EINTR)
-                throw std::system_error(errno, std::system_category());
+            for (int fd : {pipe_stdout[0], pipe_stdout[1], pipe_stderr[0], pipe_stderr[1]})
+                close(fd);
+            throw;
         }
 
         close(pipe_stdout[1]);
         close(pipe_stderr[1]);
 
-        std::unique_ptr<char[]> buf(new char[100]);
-        memset(buf.get(), 0, 100);
-
-        int bytes_read = 0;
-
-        while ((bytes_read = read(pipe_stdout[0], buf.get(), 99)))
+        // drain both pipes while the child runs; waiting first would deadlock as soon as it fills a pipe buffer
+        try
         {
-            if (bytes_read < 0 && errno != EINTR)
-                throw std::system_error(errno, std::system_category());
-            out += buf.get();
+            drain_pipes(pipe_stdout[0], out, pipe_stderr[0], err);
         }
-
-        while ((bytes_read = read(pipe_stderr[0], buf.get(), 99)))
+        catch (...)
         {
-            if (bytes_read < 0 && errno != EINTR)
-                throw std::system_error(errno, std::system_category());
-            err += buf.get();
+            // with our read ends gone the child dies of SIGPIPE at its next write, so it is safe to wait for it here
+            close(pipe_stdout[0]);
+            close(pipe_stderr[0]);
+            (void)reap_process(child_pid, started);
+            throw;
         }
 
-        return status;
+        close(pipe_stdout[0]);
+        close(pipe_stderr[0]);
+
+        return reap_process(child_pid, started).value();
     }
 } // namespace metabuild
@@ -0,0 +1,63 @@
+#pragma once
+#include "../utils/content_hash.h"
+#include "../utils/process_reactor.h"
+#include <chrono>
+#include <compiler.h>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace metabuild
+{
+    // compiler::lazy_compile split around the compiler invocation, so the process itself can be handed to a process_reactor instead of
+    // blocking the calling thread
+    class compile_job
+    {
+        std::filesystem::path in;
+        std::filesystem::path in_path;
+        std::filesystem::path root;
+        std::string prefix;
+        content_hash_type hash_type;
+        content_hasher key_hasher;
+        std::string flags_digest;
+        std::filesystem::path tmp_path;
+        std::filesystem::path depfile_path;
+        std::filesystem::file_time_type start_time;
+        // the key in the shared cache, without headers, and that same key as a manifest name; only with a shared cache
+        std::optional<content_hasher> shared_hasher;
+        std::string shared_base;
+
+        compile_job(content_hash_type hash_type) : hash_type(hash_type), key_hasher(hash_type) {}
+
+        // parse_flags plus whatever the cache needs
+        static program_arguments compile_args(const compiler& c, const compiler_flags& flags);
+        bool fetch_shared();
+        void publish_shared(const std::vector<std::filesystem::path>& deps, const std::filesystem::path& artifact) const;
+
+    public:
+        // set when the artifact is already up to date, in which case request is empty and there is nothing to run
+        std::optional<std::filesystem::path> cached;
+        process_request request;
+
+        // length of the flags digest prefix naming a variant directory
+        inline static constexpr size_t VARIANT_NAME_LEN = 16;
+
+        // the directory under root for what c builds with flags: one per compiler and flags, so several configurations of a target keep
+        // database entries of their own
+        static std::filesystem::path variant_root(const compiler& c, const compiler_flags& flags, const std::filesystem::path& root);
+
+        // hashes the inputs and consults the build database; the object itself goes to the object store
+        static tl::expected<compile_job, std::string> prepare(const compiler& c, const std::filesystem::path& in, const compiler_flags& flags,
+                                                              const std::filesystem::path& root);
+        // how long the last compile of in with these flags took, if it was recorded
+        static std::optional<std::chrono::microseconds> last_duration(const compiler& c, const std::filesystem::path& in, const compiler_flags& flags,
+                                                                      const std::filesystem::path& root);
+        // runs the compiler on the calling thread
+        process_output run() const;
+        // records the artifact once the compiler has exited
+        compiler::lazy_compile_result finish(const process_output& result);
+        // removes what a compiler that failed or was killed may have left behind
+        void abandon() const;
+    };
+} // namespace metabuild
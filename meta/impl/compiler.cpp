@@ -1,7 +1,12 @@
-#include "../utils/mmap.h"
-#include "../utils/sha256.h"
+#include "../db/build_db.h"
+#include "../db/file_hash.h"
+#include "../db/object_store.h"
+#include "../db/shared_cache.h"
+#include "../utils/depfile.h"
+#include "../utils/content_hash.h"
 #include "../utils/utils.h"
 #include "command.h"
+#include "compile_job.h"
 #include "core.h"
 #include "expected.h"
 #include "log.h"
@@ -14,6 +19,7 @@
 #include <optional>
 #include <stdexcept>
 #include <string>
+#include <utility>
 
 namespace metabuild
 {
@@ -31,13 +37,26 @@ namespace metabuild
         return flattened_name;
     }
 
-    static tl::expected<std::filesystem::path, std::string> do_compile(const std::filesystem::path& in, const std::filesystem::path& out,
-                                                                       program_arguments& args, const compiler& c)
+    static void push_output_args(program_arguments& args, const std::filesystem::path& in, const std::filesystem::path& out,
+                                 const std::optional<std::filesystem::path>& depfile = std::nullopt)
     {
+        if (depfile)
+        {
+            args.push_back("-MD");
+            args.push_back("-MF");
+            args.push_back(depfile.value());
+        }
+
         args.push_back("-c");
         args.push_back("-o");
         args.push_back(out);
         args.push_back(in);
+    }
+
+    static tl::expected<std::filesystem::path, std::string> do_compile(const std::filesystem::path& in, const std::filesystem::path& out,
+                                                                       program_arguments& args, const compiler& c)
+    {
+        push_output_args(args, in, out);
 
         std::string sout;
         std::string serr;
@@ -51,6 +70,34 @@ namespace metabuild
         return out;
     }
 
+    // extends the hash of a source with the content of every header it included last time it was compiled, each named by name(header)
+    template <typename F>
+    static std::optional<std::string> hash_headers(content_hasher s, const std::vector<std::filesystem::path>& headers, F&& name)
+    {
+        auto digests = hash_files(headers);
+        for (size_t i = 0; i < headers.size(); i++)
+        {
+            if (!digests[i])
+                return std::nullopt;
+            s.update(name(headers[i]));
+            s.update(digests[i].value());
+        }
+
+        return s.digest_str();
+    }
+
+    static std::optional<std::string> hash_with_headers(content_hasher s, const std::vector<std::filesystem::path>& headers)
+    {
+        return hash_headers(std::move(s), headers, [](const std::filesystem::path& p) { return p.string(); });
+    }
+
+    // for the shared cache: headers under the source root are named relative to it, so every checkout computes the same key
+    static std::optional<std::string> hash_with_portable_headers(content_hasher s, const std::vector<std::filesystem::path>& headers)
+    {
+        auto& shared = shared_cache::get_instance();
+        return hash_headers(std::move(s), headers, [&shared](const std::filesystem::path& p) { return shared.portable(p.string()); });
+    }
+
     METABUILD_PUBLIC tl::expected<std::filesystem::path, std::string> compiler::compile(const std::filesystem::path& in, const compiler_flags& flags,
                                                                                         const std::filesystem::path& root) const
     {
@@ -61,39 +108,244 @@ namespace metabuild
         return do_compile(in, out_path, args, *this);
     }
 
-    METABUILD_PUBLIC tl::expected<std::pair<std::filesystem::path, bool>, std::string> compiler::lazy_compile(const std::filesystem::path& in,
-                                                                                                              const compiler_flags& flags,
-                                                                                                              const std::filesystem::path& root) const
+    // compiler id and flags, recorded on their own so we can tell what the object was built with
+    static std::string hash_flags(content_hash_type type, const std::string& id, const program_arguments& args)
     {
-        std::filesystem::create_directories(root);
+        content_hasher flags_hash(type);
+        flags_hash.update(id);
+        for (const auto& i : args)
+            flags_hash.update(i);
+        return flags_hash.digest_str();
+    }
 
-        auto args = parse_flags(flags);
-        std::string id = get_id();
+    program_arguments compile_job::compile_args(const compiler& c, const compiler_flags& flags)
+    {
+        auto args = c.parse_flags(flags);
+        // objects in the shared cache must not name the checkout they were built in, in the debug info or through __FILE__
+        if (shared_cache::get_instance().enabled())
+            args.push_back("-ffile-prefix-map=" + shared_cache::root().string() + "=.");
+        return args;
+    }
+
+    std::filesystem::path compile_job::variant_root(const compiler& c, const compiler_flags& flags, const std::filesystem::path& root)
+    {
+        return root / hash_flags(get_build_config().content_hash, c.get_id(), compile_args(c, flags)).substr(0, VARIANT_NAME_LEN);
+    }
 
-        // we use the file content, compiler id and flags in order to generate a hash that uniquely identifies a binary
-        sha s;
-        s.update(mmap_file(in).buffer());
-        s.update(std::span<uint8_t>((uint8_t*)id.c_str(), id.size()));
+    tl::expected<compile_job, std::string> compile_job::prepare(const compiler& c, const std::filesystem::path& in, const compiler_flags& flags,
+                                                                const std::filesystem::path& target_root)
+    {
+        auto args = compile_args(c, flags);
+        std::string id = c.get_id();
+
+        auto src_digest = hash_file(normalize_path(in));
+        if (!src_digest)
+            return tl::unexpected("no such source file: " + in.string());
+
+        compile_job job(get_build_config().content_hash);
+        job.flags_digest = hash_flags(job.hash_type, id, args);
+
+        // every configuration has database entries of its own, so switching between them never evicts the other; the directory only holds
+        // compiles in progress
+        auto root = target_root / job.flags_digest.substr(0, VARIANT_NAME_LEN);
+        std::filesystem::create_directories(root);
+
+        // we use the file content, compiler id and flags in order to generate a hash that uniquely identifies a binary; objects are shared
+        // by every target in the object store, so the path goes in too, it ends up in __FILE__ and the debug info
+        job.key_hasher.update(src_digest.value());
+        job.key_hasher.update(normalize_path(in).string());
+        job.key_hasher.update(id);
         for (const auto& i : args)
-            s.update(std::span<uint8_t>((uint8_t*)i.c_str(), i.size()));
+            job.key_hasher.update(i);
+
+        // the same, but with every path relative to the source root, and the compiler identified by its binary rather than by its path and
+        // version string, two machines' "gcc 12" need not be the same compiler
+        auto& shared = shared_cache::get_instance();
+        // a compiler we cannot find and hash does not share its objects, the key would not tell it apart from any other
+        auto compiler_digest = shared.enabled() ? hash_file(find_executable(c.cmd().path())) : std::nullopt;
+        if (compiler_digest)
+        {
+            job.shared_hasher.emplace(job.hash_type);
+            job.shared_hasher->update(src_digest.value());
+            job.shared_hasher->update(shared.portable(normalize_path(in).string()));
+            job.shared_hasher->update(id);
+            job.shared_hasher->update(compiler_digest.value());
+            for (const auto& i : args)
+                job.shared_hasher->update(shared.portable(i));
+            job.shared_base = content_hasher(job.shared_hasher.value()).digest_str();
+        }
 
         // path stuff
-        std::string prefix = flatten_path(in);
-        std::string out_fname = prefix + "_" + s.digest_str() + ".o";
-        auto out_path = root / out_fname;
+        job.in = in;
+        job.in_path = normalize_path(in);
+        job.root = root;
+        job.prefix = flatten_path(in);
 
-        // for caching
-        if (std::filesystem::exists(out_path))
-            return {tl::in_place, out_path, false};
+        auto& db = build_db::get_instance();
+        auto record = db.get_artifact(root, job.in_path);
 
-        // remove old artifacts so that we don't bloat
-        for (const auto& i : std::filesystem::directory_iterator(root))
+        // the headers included by the previous compile are part of the key, so editing any of them yields a miss
+        if (record && !record->stale && record->hash_type == job.hash_type)
         {
-            if (i.path().filename().string().starts_with(prefix))
-                std::filesystem::remove(i.path());
+            auto key = hash_with_headers(job.key_hasher, record->deps);
+            auto artifact = object_path(record->artifact_hash, ".o");
+            if (key == record->artifact_hash && std::filesystem::exists(artifact))
+            {
+                use_object(artifact);
+                job.cached = artifact;
+                return job;
+            }
+        }
+
+        // the old object may still be used by another target, it stays in the store until evicted
+        if (record)
+        {
+            job.request.predicted_rss = record->peak_rss;
+            db.erase_artifact(root, job.in_path);
+        }
+
+        // another checkout may have compiled the same thing already
+        if (job.shared_hasher && job.fetch_shared())
+            return job;
+
+        // the header list is only known once the compiler has run, so compile to a temporary name and move it into place after
+        job.tmp_path = root / (job.prefix + ".tmp.o");
+        job.depfile_path = root / (job.prefix + ".d");
+        job.start_time = std::filesystem::file_time_type::clock::now();
+
+        push_output_args(args, in, job.tmp_path, job.depfile_path);
+        debug(fmt::format("{} {}", c.cmd().path().string(), fmt::join(args, "\n")));
+        job.request.path = c.cmd().path();
+        job.request.args = std::move(args);
+
+        return job;
+    }
+
+    std::optional<std::chrono::microseconds> compile_job::last_duration(const compiler& c, const std::filesystem::path& in,
+                                                                        const compiler_flags& flags, const std::filesystem::path& root)
+    {
+        auto record = build_db::get_instance().get_artifact(variant_root(c, flags, root), normalize_path(in));
+        if (!record || !record->duration_us)
+            return std::nullopt;
+        return std::chrono::microseconds(record->duration_us);
+    }
+
+    process_output compile_job::run() const
+    {
+        process_output result;
+        result.status = command(request.path).invoke(request.args, result.out, result.err);
+        return result;
+    }
+
+    compiler::lazy_compile_result compile_job::finish(const process_output& result)
+    {
+        if (result.status != 0)
+        {
+            abandon();
+            return tl::unexpected(result.err);
+        }
+
+        artifact_record new_record;
+        for (const auto& i : parse_depfile(depfile_path))
+        {
+            auto dep = normalize_path(i);
+            if (dep == in_path)
+                continue;
+            // a header touched while the compiler was running may not match what was compiled
+            new_record.stale |= std::filesystem::last_write_time(dep) >= start_time;
+            new_record.deps.push_back(dep);
+        }
+        std::filesystem::remove(depfile_path);
+
+        auto key = hash_with_headers(key_hasher, new_record.deps);
+        if (!key)
+            return tl::unexpected("header vanished during compile of " + in.string());
+
+        new_record.artifact_hash = key.value();
+        new_record.flags_hash = flags_digest;
+        new_record.hash_type = hash_type;
+        new_record.source_mtime = file_mtime_ns(in_path);
+        new_record.build_time = now_ns();
+        new_record.peak_rss = result.status.get_usage().max_rss;
+        new_record.duration_us = result.status.get_usage().wall_time.count();
+
+        auto out_path = object_path(new_record.artifact_hash, ".o");
+        publish_object(tmp_path, out_path);
+        build_db::get_instance().put_artifact(root, in_path, new_record);
+        if (shared_hasher && !new_record.stale)
+            publish_shared(new_record.deps, out_path);
+
+        return {tl::in_place, out_path, true};
+    }
+
+    bool compile_job::fetch_shared()
+    {
+        auto& shared = shared_cache::get_instance();
+        auto deps = shared.get_manifest(shared_base);
+        if (!deps)
+            return false;
+
+        // headers missing here mean this checkout differs from the one that published, so it is a miss
+        auto shared_key = hash_with_portable_headers(shared_hasher.value(), deps.value());
+        auto key = hash_with_headers(key_hasher, deps.value());
+        if (!shared_key || !key)
+            return false;
+
+        auto artifact = object_path(key.value(), ".o");
+        if (std::filesystem::exists(artifact))
+            use_object(artifact);
+        else if (!shared.fetch(shared_key.value(), artifact))
+            return false;
+
+        artifact_record record;
+        record.artifact_hash = key.value();
+        record.flags_hash = flags_digest;
+        record.hash_type = hash_type;
+        record.source_mtime = file_mtime_ns(in_path);
+        record.build_time = now_ns();
+        record.deps = std::move(deps.value());
+        build_db::get_instance().put_artifact(root, in_path, record);
+
+        cached = artifact;
+        return true;
+    }
+
+    void compile_job::publish_shared(const std::vector<std::filesystem::path>& deps, const std::filesystem::path& artifact) const
+    {
+        // the object is ours already, a cache we cannot write to only costs other checkouts a compile
+        try
+        {
+            auto shared_key = hash_with_portable_headers(shared_hasher.value(), deps);
+            if (!shared_key)
+                return;
+            auto& shared = shared_cache::get_instance();
+            // object first, a manifest is only worth finding when its object is there
+            shared.publish(shared_key.value(), artifact);
+            shared.put_manifest(shared_base, deps);
         }
+        catch (const std::exception& e)
+        {
+            warn(std::string("could not publish to the shared cache: ") + e.what());
+        }
+    }
+
+    void compile_job::abandon() const
+    {
+        std::error_code ec;
+        std::filesystem::remove(tmp_path, ec);
+        std::filesystem::remove(depfile_path, ec);
+    }
+
+    METABUILD_PUBLIC compiler::lazy_compile_result compiler::lazy_compile(const std::filesystem::path& in, const compiler_flags& flags,
+                                                                          const std::filesystem::path& root) const
+    {
+        auto job = compile_job::prepare(*this, in, flags, root);
+        if (!job)
+            return tl::unexpected(job.error());
+        if (job->cached)
+            return {tl::in_place, job->cached.value(), false};
 
-        return do_compile(in, out_path, args, *this).map([](const auto& i) { return std::pair<std::filesystem::path, bool>{i, true}; });
+        return job->finish(job->run());
     }
 
     inline static constexpr const char* STDLIB_FLAGS[] = {nullptr, "-stdlib=libc++", "-stdlib=libstdc++"};
@@ -214,9 +466,10 @@ namespace metabuild
                                [&compiler](const auto& p) { return std::filesystem::exists(std::filesystem::path(p) / compiler); });
         if (cc == path.end())
             throw metabuild_error(error_code::COMPILER_NOT_FOUND, "unable to find " + compiler + ", is this compiler installed on your $PATH?");
+        auto exec = std::filesystem::path(*cc) / compiler;
         std::string version_out;
-        (void)command(std::filesystem::path(*cc) / vendor).invoke({"--version"}, version_out);
-        return new c(vendor, compiler, get_version(version_out), *cc);
+        (void)command(exec).invoke({"--version"}, version_out);
+        return new c(vendor, compiler, get_version(version_out), exec);
     }
 
     METABUILD_PUBLIC const compiler& gcc_c()
@@ -0,0 +1,84 @@
+#include "diagnostics.h"
+#include "log.h"
+
+namespace metabuild
+{
+    size_t diagnostic_console::open()
+    {
+        std::lock_guard g(mtx);
+        streams[next_id];
+        return next_id++;
+    }
+
+    void diagnostic_console::write(size_t id, std::string_view chunk)
+    {
+        std::lock_guard g(mtx);
+        auto& s = streams[id];
+        s.partial += chunk;
+
+        auto end = s.partial.rfind('\n');
+        if (end == std::string::npos)
+            return;
+
+        std::string lines = s.partial.substr(0, end + 1);
+        s.partial.erase(0, end + 1);
+
+        if (!owner)
+            owner = id;
+        if (owner == id)
+            diagnostic(lines);
+        else
+            s.held += lines;
+    }
+
+    void diagnostic_console::close(size_t id)
+    {
+        std::lock_guard g(mtx);
+        auto& s = streams[id];
+        if (!s.partial.empty())
+        {
+            s.held += s.partial;
+            if (s.held.back() != '\n')
+                s.held += '\n';
+            s.partial.clear();
+        }
+        s.closed = true;
+
+        if (owner == id)
+        {
+            // the owner has streamed everything but its unterminated tail
+            diagnostic(s.held);
+            s.held.clear();
+            owner.reset();
+        }
+
+        if (!owner)
+            hand_off();
+    }
+
+    // finished jobs go out whole, then the earliest running job with something to say takes over the console
+    void diagnostic_console::hand_off()
+    {
+        for (auto it = streams.begin(); it != streams.end();)
+        {
+            if (!it->second.closed)
+            {
+                it++;
+                continue;
+            }
+            if (!it->second.held.empty())
+                diagnostic(it->second.held);
+            it = streams.erase(it);
+        }
+
+        for (auto& [id, s] : streams)
+        {
+            if (s.held.empty())
+                continue;
+            owner = id;
+            diagnostic(s.held);
+            s.held.clear();
+            break;
+        }
+    }
+} // namespace metabuild
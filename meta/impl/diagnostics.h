@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace metabuild
+{
+    // prints compiler diagnostics while the compilers run, without interleaving them: the first job to print owns the console and streams
+    // its lines as they arrive, every other job holds complete lines back until the owner is done and then goes out in one piece
+    class diagnostic_console
+    {
+        struct stream
+        {
+            // the unterminated tail of what the job wrote so far
+            std::string partial;
+            std::string held;
+            bool closed = false;
+        };
+
+        std::mutex mtx;
+        // ordered by id, so held output is flushed in the order jobs started
+        std::map<size_t, stream> streams;
+        std::optional<size_t> owner;
+        size_t next_id = 0;
+
+        void hand_off();
+
+    public:
+        size_t open();
+        void write(size_t id, std::string_view chunk);
+        // flushes whatever the job left unterminated
+        void close(size_t id);
+    };
+} // namespace metabuild
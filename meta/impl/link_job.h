@@ -0,0 +1,35 @@
+#pragma once
+#include "../utils/process_reactor.h"
+#include <expected.h>
+#include <filesystem>
+#include <linker.h>
+#include <string>
+#include <vector>
+
+namespace metabuild
+{
+    // linker::link split around the linker invocation, like compile_job
+    // links are content addressed: the key covers the linker, its arguments and the content of every object in order, the binary is
+    // stored under it in the object store and out_path is a copy of the entry
+    class link_job
+    {
+        std::filesystem::path tmp_path() const;
+
+    public:
+        std::filesystem::path out_path;
+        std::filesystem::path cache_path;
+        // set when the cache already holds the binary, in which case request is empty and there is nothing to run
+        bool cached = false;
+        process_request request;
+
+        // hashes the objects, fails if one of them is missing
+        static tl::expected<link_job, std::string> prepare(const linker& l, const std::string& out, const std::vector<std::filesystem::path>& p,
+                                                           const linker_flags& flags);
+        // moves what the linker wrote into the cache and installs it
+        tl::expected<void, std::string> finish(const process_output& result) const;
+        // removes whatever a linker that did not finish left behind
+        void abandon() const;
+        // copies the cache entry to out_path; false if it was already there, untouched
+        bool install() const;
+    };
+} // namespace metabuild
@@ -1,5 +1,10 @@
+#include "../db/file_hash.h"
+#include "../db/object_store.h"
+#include "../utils/content_hash.h"
 #include "compiler.h"
+#include <build_config.h>
 #include <linker.h>
+#include "link_job.h"
 #include "log.h"
 #include <fmt/ranges.h>
 namespace metabuild
@@ -9,27 +14,105 @@ namespace metabuild
     {
     }
 
-    METABUILD_PUBLIC tl::expected<void, std::string> linker::link(const std::string& out, const std::vector<std::filesystem::path>& p, const linker_flags& flags) const
+    tl::expected<link_job, std::string> link_job::prepare(const linker& l, const std::string& out, const std::vector<std::filesystem::path>& p,
+                                                          const linker_flags& flags)
     {
         std::filesystem::create_directory(binary_root() / "link");
-        auto out_path = binary_root() / "link" / out;
-        auto args = parse_flags(flags);
+        auto args = l.parse_flags(flags);
+
+        // the output name is left out, the same inputs produce the same binary whatever it is called
+        content_hasher key(get_build_config().content_hash);
+        key.update(l.get_id() + '\0');
+        key.update(l.cmd().path().string() + '\0');
+        for (const auto& i : args)
+            key.update(i + '\0');
+
+        auto digests = hash_files(p);
+        for (size_t i = 0; i < p.size(); i++)
+        {
+            if (!digests[i])
+                return tl::unexpected("no such object: " + p[i].string());
+            key.update(digests[i].value());
+        }
+
+        link_job job;
+        job.out_path = binary_root() / "link" / out;
+        job.cache_path = object_path(key.digest_str());
+        if (std::filesystem::exists(job.cache_path))
+        {
+            use_object(job.cache_path);
+            job.cached = true;
+            return job;
+        }
 
         args.push_back("-o");
-        args.push_back(out_path);
+        args.push_back(job.tmp_path().string());
         args.insert(args.begin(), p.begin(), p.end());
 
-        std::string sout;
-        std::string serr;
-        debug(fmt::format("{} {}", cmd().path().string(), fmt::join(args, "\n")));
+        debug(fmt::format("{} {}", l.cmd().path().string(), fmt::join(args, "\n")));
+        job.request.path = l.cmd().path();
+        job.request.args = std::move(args);
+        return job;
+    }
 
-        auto result = cmd().invoke(args, sout, serr);
+    tl::expected<void, std::string> link_job::finish(const process_output& result) const
+    {
+        if (result.status != 0)
+        {
+            abandon();
+            return tl::unexpected(result.err);
+        }
 
-        if (result != 0)
-            return tl::unexpected(serr);
+        publish_object(tmp_path(), cache_path);
+        install();
         return tl::expected<void, std::string>();
     }
 
+    std::filesystem::path link_job::tmp_path() const
+    {
+        // named after the output as well, two targets with the same inputs may be linking at the same time
+        return binary_root() / "link" / (cache_path.filename().string() + "." + out_path.filename().string() + ".tmp");
+    }
+
+    void link_job::abandon() const
+    {
+        std::error_code ec;
+        std::filesystem::remove(tmp_path(), ec);
+    }
+
+    bool link_job::install() const
+    {
+        // a copy rather than a hard link, so strip or patchelf editing out_path in place cannot corrupt the cache entry; the copy carries
+        // the entry's modification time, anything that rewrote it since no longer matches
+        std::error_code ec;
+        auto cached_time = std::filesystem::last_write_time(cache_path);
+        if (std::filesystem::last_write_time(out_path, ec) == cached_time && std::filesystem::file_size(out_path, ec) == std::filesystem::file_size(cache_path))
+            return false;
+
+        // built next to the output and renamed over it, so out_path is never missing or half written
+        std::filesystem::path tmp_path = out_path.string() + ".tmp";
+        std::filesystem::copy_file(cache_path, tmp_path, std::filesystem::copy_options::overwrite_existing);
+        std::filesystem::last_write_time(tmp_path, cached_time);
+        std::filesystem::rename(tmp_path, out_path);
+        return true;
+    }
+
+    METABUILD_PUBLIC tl::expected<void, std::string> linker::link(const std::string& out, const std::vector<std::filesystem::path>& p, const linker_flags& flags) const
+    {
+        auto job = link_job::prepare(*this, out, p, flags);
+        if (!job)
+            return tl::unexpected(job.error());
+        if (job->cached)
+        {
+            job->install();
+            return tl::expected<void, std::string>();
+        }
+
+        process_output result;
+        result.status = cmd().invoke(job->request.args, result.out, result.err);
+        return job->finish(result);
+    }
+
 #define _PRED(out, pred, val)                                                                                                                        \
     if (pred)                                                                                                                                        \
     out.push_back(val)
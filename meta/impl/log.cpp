@@ -38,6 +38,12 @@ namespace metabuild
         std::cout << "[\x1b[31mERROR\x1b[0m]: " << str << '\n';
     }
 
+    METABUILD_PUBLIC void diagnostic(const std::string& str)
+    {
+        std::lock_guard g(mtx);
+        std::cout << str << std::flush;
+    }
+
     METABUILD_PUBLIC void fatal(const std::string& str)
     {
         std::lock_guard g(mtx);
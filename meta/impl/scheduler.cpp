@@ -0,0 +1,256 @@
+#include "scheduler.h"
+#include "../utils/jobserver.h"
+#include "../utils/work_stealing_pool.h"
+#include "diagnostics.h"
+#include "log.h"
+#include <algorithm>
+#include <condition_variable>
+#include <core.h>
+#include <executable.h>
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace metabuild
+{
+    struct build_scheduler::context
+    {
+        const schedule_options& options;
+        work_stealing_pool& pool;
+        process_reactor& reactor;
+        diagnostic_console& console;
+        bool sequential;
+
+        std::mutex mtx;
+        std::condition_variable done_cv;
+        // a heap of dispatched steps no pool thread has picked up yet, the longest critical path on top
+        std::vector<size_t> ready;
+        size_t remaining;
+        std::vector<std::string> errors;
+        bool failed = false;
+        bool interrupted = false;
+
+        context(const schedule_options& options, work_stealing_pool& pool, process_reactor& reactor, diagnostic_console& console, bool sequential,
+                size_t remaining)
+            : options(options), pool(pool), reactor(reactor), console(console), sequential(sequential), remaining(remaining)
+        {
+        }
+
+        // an interrupt stops every step not yet prepared, keep_going or not
+        bool stopping()
+        {
+            std::lock_guard g(mtx);
+            if (reactor.interrupted())
+                failed = interrupted = true;
+            return interrupted || (failed && !options.keep_going);
+        }
+    };
+
+    size_t build_scheduler::add(prepare_fn prepare, finish_fn finish, bool stream_diagnostics)
+    {
+        nodes.emplace_back(std::move(prepare), std::move(finish), stream_diagnostics);
+        return nodes.size() - 1;
+    }
+
+    void build_scheduler::depend(size_t node, size_t on)
+    {
+        nodes[on].dependents.push_back(node);
+        nodes[node].pending++;
+    }
+
+    void build_scheduler::set_cost(size_t node, std::chrono::microseconds cost) { nodes[node].cost = cost; }
+
+    std::chrono::microseconds build_scheduler::critical_path(size_t id)
+    {
+        auto& n = nodes[id];
+        if (n.remaining.count() < 0)
+        {
+            std::chrono::microseconds longest{0};
+            for (auto i : n.dependents)
+                longest = std::max(longest, critical_path(i));
+            n.remaining = n.cost + longest;
+        }
+        return n.remaining;
+    }
+
+    // the first failure stops the build, and whatever else failed before it stopped is reported along with it; with keep_going every step
+    // that does not depend on a failed one still runs
+    void build_scheduler::fail(context& ctx, const std::string& what)
+    {
+        bool first;
+        {
+            std::lock_guard g(ctx.mtx);
+            ctx.errors.push_back(what);
+            first = !std::exchange(ctx.failed, true);
+        }
+        if (first && !ctx.options.keep_going)
+            ctx.reactor.cancel();
+    }
+
+    // called with ctx.mtx held
+    void build_scheduler::settle(context& ctx, size_t id, bool ok)
+    {
+        nodes[id].state = node_state::DONE;
+        for (auto i : nodes[id].dependents)
+        {
+            if (!ok)
+            {
+                // skipped along with everything downstream of it
+                if (nodes[i].state == node_state::WAITING)
+                    settle(ctx, i, false);
+            }
+            else if (--nodes[i].pending == 0 && nodes[i].state == node_state::WAITING)
+                dispatch(ctx, i);
+        }
+
+        if (--ctx.remaining == 0)
+            ctx.done_cv.notify_all();
+    }
+
+    void build_scheduler::complete(context& ctx, size_t id, bool ok)
+    {
+        std::lock_guard g(ctx.mtx);
+        settle(ctx, id, ok);
+    }
+
+    void build_scheduler::finish(context& ctx, size_t id, const process_output* result)
+    {
+        bool ok = !result || !result->cancelled;
+        try
+        {
+            nodes[id].finish(result);
+        }
+        catch (const std::exception& e)
+        {
+            fail(ctx, e.what());
+            ok = false;
+        }
+        complete(ctx, id, ok);
+    }
+
+    // called with ctx.mtx held
+    void build_scheduler::dispatch(context& ctx, size_t id)
+    {
+        auto later = [this](size_t a, size_t b) {
+            // ties go to the step added first, which keeps declaration order when nothing is known
+            return nodes[a].remaining != nodes[b].remaining ? nodes[a].remaining < nodes[b].remaining : a > b;
+        };
+
+        nodes[id].state = node_state::DISPATCHED;
+        ctx.ready.push_back(id);
+        std::push_heap(ctx.ready.begin(), ctx.ready.end(), later);
+
+        // every task takes whichever step is most urgent by the time a thread gets to it, not the one that was dispatched with it
+        ctx.pool.push_task([this, &ctx, later]() {
+            size_t next;
+            {
+                std::lock_guard g(ctx.mtx);
+                std::pop_heap(ctx.ready.begin(), ctx.ready.end(), later);
+                next = ctx.ready.back();
+                ctx.ready.pop_back();
+            }
+            execute(ctx, next);
+        });
+    }
+
+    void build_scheduler::execute(context& ctx, size_t id)
+    {
+        auto& n = nodes[id];
+        if (ctx.stopping())
+            return complete(ctx, id, false);
+
+        std::optional<process_request> request;
+        try
+        {
+            request = n.prepare();
+        }
+        catch (const std::exception& e)
+        {
+            fail(ctx, e.what());
+            return complete(ctx, id, false);
+        }
+        if (!request)
+            return finish(ctx, id, nullptr);
+        request->priority = n.remaining.count();
+
+        std::optional<size_t> console_id;
+        if (n.stream_diagnostics)
+        {
+            console_id = ctx.console.open();
+            request->on_err = [&console = ctx.console, id = *console_id](std::string_view chunk) { console.write(id, chunk); };
+        }
+
+        // one step at a time: the pool thread waits for the process, so each step finishes before the next one starts
+        if (ctx.sequential)
+        {
+            auto result = ctx.reactor.submit(std::move(*request)).get();
+            if (console_id)
+                ctx.console.close(*console_id);
+            return finish(ctx, id, &result);
+        }
+
+        ctx.reactor.submit(std::move(*request), [this, &ctx, id, console_id](process_output result) {
+            if (console_id)
+                ctx.console.close(*console_id);
+            // back onto the pool, the reactor thread must not block on hashing
+            ctx.pool.push_task([this, &ctx, id, result = std::move(result)]() { finish(ctx, id, &result); });
+        });
+    }
+
+    void build_scheduler::run(const schedule_options& options)
+    {
+        if (nodes.empty())
+            return;
+
+        // diagnostics reach the console while the processes run, so a failure is only named in the error
+        diagnostic_console console;
+
+        bool sequential = options.threads == -1;
+        bool adaptive = options.threads == executable::ADAPTIVE;
+        unsigned hw_threads = std::thread::hardware_concurrency();
+
+        // the pool only hashes and bookkeeps; processes are supervised by the reactor, so a job slot does not cost a thread
+        work_stealing_pool tp(sequential ? 1 : options.threads > 0 ? std::min<unsigned>(options.threads, hw_threads) : 0);
+        size_t jobs = sequential ? 1 : options.threads > 0 ? options.threads : tp.get_thread_count();
+
+        // adaptive builds may go past one job per thread while nothing stalls, jobs that block on io leave cores idle
+        process_reactor reactor(adaptive ? 2 * jobs : jobs, options.memory_budget * 1024);
+        if (adaptive)
+            reactor.adapt_to_pressure(jobs);
+        // only a jobserver joined from make limits us; one we host feeds the nested builds our commands start, and its one slot per hardware
+        // thread would otherwise cap adaptive and oversubscribed builds
+        if (!sequential && !jobserver::get_instance().is_hosting())
+            reactor.use_jobserver(jobserver::get_instance());
+        reactor.cancel_on_signal();
+
+        if (!sequential && !options.quiet)
+            info(adaptive ? "building with up to " + std::to_string(2 * jobs) + " jobs, adapting to pressure"
+                          : "building with " + std::to_string(jobs) + " jobs");
+
+        for (size_t i = 0; i < nodes.size(); i++)
+            critical_path(i);
+
+        context ctx(options, tp, reactor, console, sequential, nodes.size());
+        {
+            std::unique_lock g(ctx.mtx);
+            for (size_t i = 0; i < nodes.size(); i++)
+            {
+                if (nodes[i].pending == 0)
+                    dispatch(ctx, i);
+            }
+            ctx.done_cv.wait(g, [&]() { return ctx.remaining == 0; });
+        }
+        // the last step may still be returning from complete()
+        tp.wait_for_tasks();
+
+        if (reactor.interrupted())
+            throw metabuild_error(error_code::BUILD_INTERRUPTED, "build interrupted");
+        if (ctx.errors.size() == 1)
+            throw metabuild_error(error_code::BUILD_FAILED, ctx.errors.front());
+        if (!ctx.errors.empty())
+            throw metabuild_error(error_code::BUILD_FAILED, fmt::format("{} build steps failed:\n{}", ctx.errors.size(), fmt::join(ctx.errors, "\n")));
+    }
+} // namespace metabuild
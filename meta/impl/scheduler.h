@@ -0,0 +1,84 @@
+#pragma once
+#include "../utils/process_reactor.h"
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace metabuild
+{
+    struct schedule_options
+    {
+        // -1 runs one step at a time, 0 one job per hardware thread, executable::ADAPTIVE follows pressure
+        int threads = -1;
+        // in megabytes, 0 uses what is available when the build starts
+        size_t memory_budget = 0;
+        bool keep_going = false;
+        bool quiet = false;
+    };
+
+    // a dependency graph of build steps, compiles and links of any number of targets, run by one pool and one process reactor; a step
+    // starts as soon as everything it depends on has finished, so independent targets overlap and no core waits on another target's link
+    // among the steps that are ready, the one heading the longest chain of expected work still ahead goes first, so a slow compile is not
+    // left to run alone at the end of the build
+    class build_scheduler
+    {
+    public:
+        // runs on the pool; returns the process the step needs, or nothing when it is already up to date. throws to fail the step
+        using prepare_fn = std::function<std::optional<process_request>()>;
+        // runs on the pool with the output of that process, or nullptr when there was none; cancelled output is passed as well, so the
+        // step can clean up after itself. throws to fail the step
+        using finish_fn = std::function<void(const process_output*)>;
+
+    private:
+        enum class node_state
+        {
+            WAITING,
+            DISPATCHED,
+            DONE
+        };
+
+        struct node
+        {
+            prepare_fn prepare;
+            finish_fn finish;
+            bool stream_diagnostics;
+            std::chrono::microseconds cost{0};
+            // cost plus the costliest chain of dependents, the length of the critical path from here to the end
+            std::chrono::microseconds remaining{-1};
+            std::vector<size_t> dependents;
+            size_t pending = 0;
+            node_state state = node_state::WAITING;
+
+            node(prepare_fn prepare, finish_fn finish, bool stream_diagnostics)
+                : prepare(std::move(prepare)), finish(std::move(finish)), stream_diagnostics(stream_diagnostics)
+            {
+            }
+        };
+
+        struct context;
+
+        std::vector<node> nodes;
+
+        std::chrono::microseconds critical_path(size_t id);
+        void dispatch(context& ctx, size_t id);
+        void execute(context& ctx, size_t id);
+        void finish(context& ctx, size_t id, const process_output* result);
+        void fail(context& ctx, const std::string& what);
+        void complete(context& ctx, size_t id, bool ok);
+        void settle(context& ctx, size_t id, bool ok);
+
+    public:
+        // with stream_diagnostics the process's stderr goes to the console while it runs, otherwise it is only collected
+        size_t add(prepare_fn prepare, finish_fn finish, bool stream_diagnostics = true);
+        // node does not start before on has finished, and is skipped if on fails
+        void depend(size_t node, size_t on);
+        // how long the step is expected to take, steps without an estimate count as free
+        void set_cost(size_t node, std::chrono::microseconds cost);
+
+        // runs every step, then throws metabuild_error if any step failed or the build was interrupted
+        void run(const schedule_options& options);
+    };
+} // namespace metabuild
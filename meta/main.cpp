@@ -1,11 +1,16 @@
 #include "dl/dl.h"
 #include "state.h"
+#include "utils/content_hash.h"
+#include "utils/jobserver.h"
 #include "utils/mmap.h"
 #include "utils/utils.h"
 #include <argparse/argparse.hpp>
+#include <charconv>
 #include <compiler.h>
 #include <core.h>
+#include <cstdint>
 #include <dlfcn.h>
+#include <cstdlib>
 #include <exception>
 #include <filesystem>
 #include <fmt/core.h>
@@ -49,6 +54,9 @@ int prog_main(int argc, char** argv)
     program.add_argument("--list-buildtypes").help("lists available build types").default_value(false).implicit_value(true);
     program.add_argument("--sources").help("specifies the sources directory").default_value(std::string(".")).required();
     program.add_argument("--out").help("specifies the binary/output directory").default_value(std::string(".build/")).required();
+    program.add_argument("--hash").help("content hash used for the compile cache (sha256 or blake3)").default_value(std::string("sha256"));
+    program.add_argument("--cache-size").help("how large the object store may grow, in megabytes").default_value(std::string("10240"));
+    program.add_argument("--shared-cache").help("compile cache shared between checkouts, defaults to $METABUILD_SHARED_CACHE").default_value(std::string(""));
     program.add_argument("build-type").help("sets the type of build");
     program.add_argument("buildscript-args").help("the arguments to pass to buildscript itself").append().nargs(argparse::nargs_pattern::any);
 
@@ -78,6 +86,33 @@ int prog_main(int argc, char** argv)
     state_data::get_instance().sources_dir = normalize_path(program.get<std::string>("--sources"));
     state_data::get_instance().binary_dir = normalize_path(state_data::get_instance().sources_dir / program.get<std::string>("--out"));
 
+    auto hash = program.get<std::string>("--hash");
+    if (hash == "blake3")
+        state_data::get_instance().content_hash = HASH_BLAKE3;
+    else if (hash != "sha256")
+        fatal(fmt::format("unknown hash: {}", hash));
+    debug(fmt::format("fingerprinting inputs with {}", content_hasher::name(state_data::get_instance().content_hash)));
+
+    // a whole number of megabytes that still fits in bytes; from_chars takes no sign and no trailing junk, unlike stoull
+    auto cache_size = program.get<std::string>("--cache-size");
+    uint64_t cache_mb = 0;
+    auto [cache_end, cache_ec] = std::from_chars(cache_size.data(), cache_size.data() + cache_size.size(), cache_mb);
+    if (cache_ec != std::errc() || cache_end != cache_size.data() + cache_size.size() || cache_mb > (UINT64_MAX >> 20))
+        fatal(fmt::format("bad cache size: {}", cache_size));
+    state_data::get_instance().object_store_limit = cache_mb;
+
+    auto shared_cache = program.get<std::string>("--shared-cache");
+    if (shared_cache.empty() && getenv("METABUILD_SHARED_CACHE"))
+        shared_cache = getenv("METABUILD_SHARED_CACHE");
+    if (!shared_cache.empty())
+        state_data::get_instance().shared_cache = normalize_path(shared_cache);
+
+    // join make's jobserver, or host one, before the first child is spawned: hosting exports it through MAKEFLAGS
+    if (jobserver::get_instance().is_hosting())
+        debug("hosting a jobserver");
+    else
+        debug("joined the jobserver from MAKEFLAGS");
+
     info("CC is: " + system_compiler_c().get_id());
     info("CXX is: " + system_compiler_cpp().get_id());
 
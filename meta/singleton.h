@@ -9,8 +9,9 @@ public:
 
     static T& get_instance()
     {
-        if (!instance)
-            instance = new _T_inst;
+        // initialization of a function local static is thread safe; the instance is deliberately never destroyed since worker threads may
+        // still be using it while exit() runs
+        static T* instance = new _T_inst;
         return *instance;
     }
 
@@ -22,6 +23,4 @@ private:
     {
         _T_inst() : T() {}
     };
-
-    static inline T* instance = nullptr;
 };
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "singleton.h"
+#include <build_config.h>
 #include <filesystem>
 namespace metabuild
 {
@@ -9,5 +10,8 @@ namespace metabuild
         std::filesystem::path sources_dir;
         std::filesystem::path binary_dir;
         int verbosity;
+        content_hash_type content_hash = HASH_SHA256;
+        size_t object_store_limit = 10240;
+        std::filesystem::path shared_cache;
     };
 } // namespace metabuild
@@ -0,0 +1,89 @@
+#include "blake3.h"
+#include "work_stealing_pool.h"
+#include <array>
+#include <latch>
+
+// below this, handing pieces to other threads costs more than it saves
+inline static constexpr size_t PARALLEL_MIN = 1 << 20;
+
+static size_t left_len(size_t len)
+{
+    // the left subtree holds the largest power of two number of chunks that leaves the right one non-empty
+    size_t full_chunks = (len - 1) / blake3::CHUNK_LEN;
+    size_t chunks = 1;
+    while (chunks * 2 <= full_chunks)
+        chunks *= 2;
+    return chunks * blake3::CHUNK_LEN;
+}
+
+void blake3::subtree_cv(const uint8_t* in, size_t len, uint64_t chunk_counter, uint32_t* out)
+{
+    if (len <= CHUNK_LEN)
+    {
+        chunk_state c(chunk_counter);
+        c.update(in, len);
+        c.get_output().chaining_value(out);
+        return;
+    }
+
+    size_t left = left_len(len);
+    uint32_t l[8];
+    uint32_t r[8];
+    subtree_cv(in, left, chunk_counter, l);
+    subtree_cv(in + left, len - left, chunk_counter + left / CHUNK_LEN, r);
+    parent_output(l, r).chaining_value(out);
+}
+
+std::string blake3::digest_str_parallel(const std::span<uint8_t>& buf)
+{
+    static work_stealing_pool pool;
+
+    if (buf.size() <= PARALLEL_MIN || pool.get_thread_count() < 2)
+    {
+        blake3 b;
+        b.update(buf);
+        return b.digest_str();
+    }
+
+    // aligned pieces of a power of two number of chunks are exactly the subtrees of the full tree, so they can be hashed independently
+    // and then merged with the same left-balanced rule
+    size_t piece = CHUNK_LEN;
+    while (piece * pool.get_thread_count() * 4 < buf.size())
+        piece <<= 1;
+
+    size_t count = (buf.size() + piece - 1) / piece;
+    std::vector<std::array<uint32_t, 8>> cvs(count);
+
+    // waits on the pieces of this buffer only, other threads may be hashing through the same pool
+    std::latch done(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        pool.push_task([&, i]() {
+            subtree_cv(buf.data() + i * piece, std::min(piece, buf.size() - i * piece), i * piece / CHUNK_LEN, cvs[i].data());
+            done.count_down();
+        });
+    }
+    done.wait();
+
+    auto merge = [&](auto& self, size_t lo, size_t hi) -> output {
+        size_t left = 1;
+        while (left * 2 < hi - lo)
+            left *= 2;
+
+        std::array<uint32_t, 8> l;
+        std::array<uint32_t, 8> r;
+        if (left == 1)
+            l = cvs[lo];
+        else
+            self(self, lo, lo + left).chaining_value(l.data());
+        if (hi - lo - left == 1)
+            r = cvs[lo + left];
+        else
+            self(self, lo + left, hi).chaining_value(r.data());
+        return parent_output(l.data(), r.data());
+    };
+
+    uint32_t words[8];
+    merge(merge, 0, count).root_value(words);
+    return fmt::format("{:0>2x}", fmt::join(to_bytes(words), ""));
+}
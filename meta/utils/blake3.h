@@ -0,0 +1,258 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fmt/core.h>
+#include <fmt/ranges.h>
+#include <span>
+#include <string>
+#include <vector>
+
+// portable blake3 (hash mode only), exposing the same streaming interface as sha
+class blake3
+{
+public:
+    inline static constexpr size_t BLOCK_LEN = 64;
+    inline static constexpr size_t CHUNK_LEN = 1024;
+
+private:
+    inline static constexpr uint32_t IV[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    inline static constexpr uint8_t MSG_PERMUTATION[16] = {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8};
+
+    enum flags : uint32_t
+    {
+        CHUNK_START = 1 << 0,
+        CHUNK_END = 1 << 1,
+        PARENT = 1 << 2,
+        ROOT = 1 << 3,
+    };
+
+    static constexpr uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    static constexpr void g(uint32_t* s, int a, int b, int c, int d, uint32_t mx, uint32_t my)
+    {
+        s[a] = s[a] + s[b] + mx;
+        s[d] = rotr(s[d] ^ s[a], 16);
+        s[c] = s[c] + s[d];
+        s[b] = rotr(s[b] ^ s[c], 12);
+        s[a] = s[a] + s[b] + my;
+        s[d] = rotr(s[d] ^ s[a], 8);
+        s[c] = s[c] + s[d];
+        s[b] = rotr(s[b] ^ s[c], 7);
+    }
+
+    static constexpr void compress(const uint32_t* cv, const uint32_t* block, uint64_t counter, uint32_t block_len, uint32_t flags,
+                                   uint32_t* out)
+    {
+        uint32_t s[16] = {cv[0], cv[1], cv[2], cv[3], cv[4],  cv[5],  cv[6],     cv[7], IV[0], IV[1], IV[2], IV[3], (uint32_t)counter,
+                          (uint32_t)(counter >> 32), block_len, flags};
+        uint32_t m[16];
+        uint32_t tmp[16];
+        for (int i = 0; i < 16; i++)
+            m[i] = block[i];
+
+        for (int round = 0; round < 7; round++)
+        {
+            g(s, 0, 4, 8, 12, m[0], m[1]);
+            g(s, 1, 5, 9, 13, m[2], m[3]);
+            g(s, 2, 6, 10, 14, m[4], m[5]);
+            g(s, 3, 7, 11, 15, m[6], m[7]);
+            g(s, 0, 5, 10, 15, m[8], m[9]);
+            g(s, 1, 6, 11, 12, m[10], m[11]);
+            g(s, 2, 7, 8, 13, m[12], m[13]);
+            g(s, 3, 4, 9, 14, m[14], m[15]);
+
+            for (int i = 0; i < 16; i++)
+                tmp[i] = m[MSG_PERMUTATION[i]];
+            for (int i = 0; i < 16; i++)
+                m[i] = tmp[i];
+        }
+
+        for (int i = 0; i < 8; i++)
+        {
+            out[i] = s[i] ^ s[i + 8];
+            out[i + 8] = s[i + 8] ^ cv[i];
+        }
+    }
+
+    static constexpr void load_block(const uint8_t* bytes, size_t len, uint32_t* words)
+    {
+        uint8_t padded[BLOCK_LEN] = {};
+        for (size_t i = 0; i < len; i++)
+            padded[i] = bytes[i];
+        for (int i = 0; i < 16; i++)
+            words[i] = (uint32_t)padded[i * 4] | ((uint32_t)padded[i * 4 + 1] << 8) | ((uint32_t)padded[i * 4 + 2] << 16) |
+                       ((uint32_t)padded[i * 4 + 3] << 24);
+    }
+
+    // a node whose compression has not run yet, since whether it gets the ROOT flag is only known at the end
+    struct output
+    {
+        uint32_t cv[8];
+        uint32_t block[16];
+        uint64_t counter;
+        uint32_t block_len;
+        uint32_t flags;
+
+        constexpr void chaining_value(uint32_t* out) const
+        {
+            uint32_t full[16];
+            compress(cv, block, counter, block_len, flags, full);
+            for (int i = 0; i < 8; i++)
+                out[i] = full[i];
+        }
+
+        constexpr void root_value(uint32_t* out) const
+        {
+            uint32_t full[16];
+            compress(cv, block, 0, block_len, flags | ROOT, full);
+            for (int i = 0; i < 8; i++)
+                out[i] = full[i];
+        }
+    };
+
+    struct chunk_state
+    {
+        uint32_t cv[8];
+        uint64_t counter;
+        uint8_t block[BLOCK_LEN];
+        uint32_t block_len = 0;
+        uint32_t blocks_compressed = 0;
+
+        constexpr chunk_state(uint64_t counter) : counter(counter)
+        {
+            for (int i = 0; i < 8; i++)
+                cv[i] = IV[i];
+        }
+
+        constexpr size_t len() const { return blocks_compressed * BLOCK_LEN + block_len; }
+        constexpr uint32_t start_flag() const { return blocks_compressed == 0 ? (uint32_t)CHUNK_START : 0u; }
+
+        constexpr void update(const uint8_t* in, size_t len)
+        {
+            while (len)
+            {
+                // only compress a full block once we know it is not the last one in the chunk
+                if (block_len == BLOCK_LEN)
+                {
+                    uint32_t words[16];
+                    uint32_t full[16];
+                    load_block(block, BLOCK_LEN, words);
+                    compress(cv, words, counter, BLOCK_LEN, start_flag(), full);
+                    for (int i = 0; i < 8; i++)
+                        cv[i] = full[i];
+                    blocks_compressed++;
+                    block_len = 0;
+                }
+
+                size_t take = std::min(BLOCK_LEN - block_len, len);
+                for (size_t i = 0; i < take; i++)
+                    block[block_len + i] = in[i];
+                block_len += take;
+                in += take;
+                len -= take;
+            }
+        }
+
+        constexpr output get_output() const
+        {
+            output o{};
+            for (int i = 0; i < 8; i++)
+                o.cv[i] = cv[i];
+            load_block(block, block_len, o.block);
+            o.counter = counter;
+            o.block_len = block_len;
+            o.flags = start_flag() | CHUNK_END;
+            return o;
+        }
+    };
+
+    static constexpr output parent_output(const uint32_t* left, const uint32_t* right)
+    {
+        output o{};
+        for (int i = 0; i < 8; i++)
+        {
+            o.cv[i] = IV[i];
+            o.block[i] = left[i];
+            o.block[i + 8] = right[i];
+        }
+        o.counter = 0;
+        o.block_len = BLOCK_LEN;
+        o.flags = PARENT;
+        return o;
+    }
+
+    chunk_state chunk{0};
+    uint32_t cv_stack[54][8];
+    uint8_t cv_stack_len = 0;
+
+    // merges completed subtrees; the number of trailing zero bits in the chunk count is how many merges are due
+    constexpr void add_chunk_cv(uint32_t* cv, uint64_t total_chunks)
+    {
+        while ((total_chunks & 1) == 0)
+        {
+            parent_output(cv_stack[--cv_stack_len], cv).chaining_value(cv);
+            total_chunks >>= 1;
+        }
+        for (int i = 0; i < 8; i++)
+            cv_stack[cv_stack_len][i] = cv[i];
+        cv_stack_len++;
+    }
+
+    static std::vector<uint8_t> to_bytes(const uint32_t* words)
+    {
+        std::vector<uint8_t> digest(32);
+        for (int i = 0; i < 8; i++)
+            for (int j = 0; j < 4; j++)
+                digest[i * 4 + j] = (uint8_t)(words[i] >> (8 * j));
+        return digest;
+    }
+
+    // chaining value of a whole (non-root) subtree starting at the given chunk, used to hash disjoint parts of a buffer on separate threads
+    static void subtree_cv(const uint8_t* in, size_t len, uint64_t chunk_counter, uint32_t* out);
+
+public:
+    constexpr void update(const std::span<uint8_t>& buf)
+    {
+        const uint8_t* in = buf.data();
+        size_t len = buf.size();
+
+        while (len)
+        {
+            if (chunk.len() == CHUNK_LEN)
+            {
+                uint32_t cv[8];
+                chunk.get_output().chaining_value(cv);
+                uint64_t total_chunks = chunk.counter + 1;
+                add_chunk_cv(cv, total_chunks);
+                chunk = chunk_state(total_chunks);
+            }
+
+            size_t take = std::min(CHUNK_LEN - chunk.len(), len);
+            chunk.update(in, take);
+            in += take;
+            len -= take;
+        }
+    }
+
+    std::vector<uint8_t> get_digest() const
+    {
+        output o = chunk.get_output();
+        for (size_t i = cv_stack_len; i > 0; i--)
+        {
+            uint32_t cv[8];
+            o.chaining_value(cv);
+            o = parent_output(cv_stack[i - 1], cv);
+        }
+
+        uint32_t words[8];
+        o.root_value(words);
+        return to_bytes(words);
+    }
+
+    inline std::string digest_str() const { return fmt::format("{:0>2x}", fmt::join(get_digest(), "")); }
+
+    // the tree structure lets a single large buffer be split into subtrees hashed across threads; the result is identical to
+    // feeding the whole buffer through update()
+    static std::string digest_str_parallel(const std::span<uint8_t>& buf);
+};
@@ -0,0 +1,43 @@
+#include "content_hash.h"
+
+content_hasher::content_hasher(metabuild::content_hash_type type)
+{
+    if (type == metabuild::HASH_BLAKE3)
+        impl.emplace<blake3>();
+    else
+        impl.emplace<sha>();
+}
+
+void content_hasher::update(const std::span<uint8_t>& buf)
+{
+    std::visit([&](auto& h) { h.update(buf); }, impl);
+}
+
+std::string content_hasher::digest_str()
+{
+    return std::visit([](auto& h) { return h.digest_str(); }, impl);
+}
+
+const char* content_hasher::name(metabuild::content_hash_type type)
+{
+    switch (type)
+    {
+    case metabuild::HASH_SHA256:
+        return "sha256";
+    case metabuild::HASH_BLAKE3:
+        return "blake3";
+    }
+    return "unknown";
+}
+
+std::vector<std::string> content_hasher::digest_str_many(metabuild::content_hash_type type, const std::vector<std::span<uint8_t>>& bufs)
+{
+    if (type == metabuild::HASH_SHA256)
+        return sha::digest_str_many(bufs);
+
+    // large generated sources are split into subtrees across threads, everything else is cheap enough to do inline
+    std::vector<std::string> out;
+    for (const auto& i : bufs)
+        out.push_back(blake3::digest_str_parallel(i));
+    return out;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "blake3.h"
+#include "sha256.h"
+#include <build_config.h>
+#include <span>
+#include <string>
+#include <variant>
+#include <vector>
+
+// the hash used to fingerprint build inputs, chosen through build_config::content_hash
+// mirrors the interface of sha so either implementation can sit behind it
+class content_hasher
+{
+    std::variant<sha, blake3> impl;
+
+public:
+    content_hasher(metabuild::content_hash_type type);
+
+    void update(const std::span<uint8_t>& buf);
+    void update(const std::string& str) { update(std::span<uint8_t>((uint8_t*)str.data(), str.size())); }
+    std::string digest_str();
+
+    static const char* name(metabuild::content_hash_type type);
+
+    // hashes independent buffers in one go, using whatever batching or threading the algorithm supports
+    static std::vector<std::string> digest_str_many(metabuild::content_hash_type type, const std::vector<std::span<uint8_t>>& bufs);
+};
@@ -0,0 +1,54 @@
+#include "depfile.h"
+#include <fstream>
+#include <iterator>
+#include <string>
+
+std::vector<std::filesystem::path> parse_depfile(const std::filesystem::path& path)
+{
+    std::ifstream ifs(path);
+    std::string content((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+
+    std::vector<std::filesystem::path> deps;
+    std::string curr;
+
+    auto flush = [&](bool is_target) {
+        if (!curr.empty() && !is_target)
+            deps.push_back(curr);
+        curr.clear();
+    };
+
+    for (size_t i = 0; i < content.size(); i++)
+    {
+        char ch = content[i];
+        char next = i + 1 < content.size() ? content[i + 1] : '\0';
+
+        if (ch == '\\' && (next == '\n' || (next == '\r' && i + 2 < content.size() && content[i + 2] == '\n')))
+        {
+            // line continuation
+            flush(false);
+            i += next == '\r' ? 2 : 1;
+        }
+        else if (ch == '\\' && (next == ' ' || next == '#'))
+        {
+            curr += next;
+            i++;
+        }
+        else if (ch == '$' && next == '$')
+        {
+            curr += '$';
+            i++;
+        }
+        else if (ch == ':' && (next == ' ' || next == '\t' || next == '\n' || next == '\r' || next == '\0'))
+        {
+            // everything before the colon is the rule target
+            flush(true);
+        }
+        else if (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r')
+            flush(false);
+        else
+            curr += ch;
+    }
+
+    flush(false);
+    return deps;
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include <filesystem>
+#include <vector>
+
+// parses a make-style dependency file (as emitted by -MD -MF), returning every prerequisite of every rule
+std::vector<std::filesystem::path> parse_depfile(const std::filesystem::path& path);
@@ -0,0 +1,136 @@
+#include "jobserver.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+
+// the token byte make itself writes, used for the slots of a jobserver we host
+inline static constexpr char JOBSERVER_TOKEN = '+';
+
+static int open_nonblocking(const std::string& path, int flags) { return open(path.c_str(), flags | O_NONBLOCK | O_CLOEXEC); }
+
+jobserver::jobserver()
+{
+    auto makeflags = getenv("MAKEFLAGS");
+    if (makeflags && join(makeflags))
+        return;
+
+    unsigned threads = std::thread::hardware_concurrency();
+    host(threads ? threads : 1);
+}
+
+jobserver::~jobserver()
+{
+    for (char token : held)
+        (void)!write(write_fd, &token, 1);
+    close(read_fd);
+    if (owns_write_fd)
+        close(write_fd);
+}
+
+bool jobserver::join(const std::string& makeflags)
+{
+    // the last occurrence wins, sub-makes append theirs; older makes spell it --jobserver-fds
+    std::string auth;
+    size_t auth_pos = 0;
+    for (const char* option : {"--jobserver-fds=", "--jobserver-auth="})
+    {
+        auto pos = makeflags.rfind(option);
+        if (pos == std::string::npos || (!auth.empty() && pos < auth_pos))
+            continue;
+        auth_pos = pos;
+        pos += strlen(option);
+        auth = makeflags.substr(pos, makeflags.find(' ', pos) - pos);
+    }
+
+    if (auth.starts_with("fifo:"))
+    {
+        auto path = auth.substr(5);
+        read_fd = open_nonblocking(path, O_RDONLY);
+        // opened after the read side, so a reader exists and a non-blocking open for writing succeeds
+        write_fd = read_fd < 0 ? -1 : open_nonblocking(path, O_WRONLY);
+        owns_write_fd = true;
+    }
+    else
+    {
+        int r, w;
+        if (sscanf(auth.c_str(), "%d,%d", &r, &w) != 2)
+            return false;
+        // make leaves these out of recipes not marked with '+', in which case the numbers refer to nothing (or something else)
+        if (fcntl(r, F_GETFD) < 0 || fcntl(w, F_GETFD) < 0)
+            return false;
+
+        // a fresh open of the same pipe gives us a description of our own to make non-blocking
+        read_fd = open_nonblocking("/proc/self/fd/" + std::to_string(r), O_RDONLY);
+        write_fd = w;
+        owns_write_fd = false;
+    }
+
+    if (read_fd >= 0 && write_fd >= 0)
+        return true;
+
+    if (read_fd >= 0)
+        close(read_fd);
+    read_fd = write_fd = -1;
+    owns_write_fd = false;
+    return false;
+}
+
+void jobserver::host(size_t slots)
+{
+    // not close-on-exec: children find the pool through these descriptors
+    int fds[2];
+    if (pipe(fds) < 0)
+        throw std::system_error(errno, std::system_category());
+
+    // the implicit slot is ours, every other one is a token in the pipe
+    std::string tokens(slots - 1, JOBSERVER_TOKEN);
+    if (!tokens.empty() && write(fds[1], tokens.data(), tokens.size()) != (ssize_t)tokens.size())
+        throw std::system_error(errno, std::system_category());
+
+    read_fd = open_nonblocking("/proc/self/fd/" + std::to_string(fds[0]), O_RDONLY);
+    if (read_fd < 0)
+        throw std::system_error(errno, std::system_category());
+    write_fd = fds[1];
+    owns_write_fd = true;
+    hosting = true;
+
+    std::string makeflags = getenv("MAKEFLAGS") ? getenv("MAKEFLAGS") : "";
+    makeflags += " -j" + std::to_string(slots) + " --jobserver-auth=" + std::to_string(fds[0]) + "," + std::to_string(fds[1]);
+    setenv("MAKEFLAGS", makeflags.c_str(), 1);
+}
+
+bool jobserver::try_acquire()
+{
+    char token;
+    while (true)
+    {
+        auto n = read(read_fd, &token, 1);
+        if (n == 1)
+        {
+            std::lock_guard g(mtx);
+            held.push_back(token);
+            return true;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        return false;
+    }
+}
+
+void jobserver::release()
+{
+    char token;
+    {
+        std::lock_guard g(mtx);
+        token = held.back();
+        held.pop_back();
+    }
+    while (write(write_fd, &token, 1) < 0 && errno == EINTR)
+        ;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "../singleton.h"
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// a GNU make jobserver: a pipe or fifo holding one byte per job slot beyond the implicit one every participant starts with
+// when MAKEFLAGS names one (pipe "--jobserver-auth=R,W" or fifo "--jobserver-auth=fifo:PATH") we join it, otherwise we host our own with one
+// slot per hardware thread and export it through MAKEFLAGS, so make, ninja or metabuild started by our commands draw from the same pool
+// get_instance() must run before the first child is spawned, since hosting edits the environment children inherit
+class jobserver : public singleton<jobserver>
+{
+    // our own non-blocking read side; the descriptions shared with other processes stay blocking, as make expects
+    int read_fd = -1;
+    int write_fd = -1;
+    bool owns_write_fd = false;
+    bool hosting = false;
+    // make hands out arbitrary bytes and expects the same ones back
+    std::mutex mtx;
+    std::vector<char> held;
+
+    bool join(const std::string& makeflags);
+    void host(size_t slots);
+
+protected:
+    jobserver();
+
+public:
+    ~jobserver();
+
+    // takes a token without blocking, false when none is free right now
+    bool try_acquire();
+    void release();
+
+    // readable whenever a token may be free
+    int fd() const { return read_fd; }
+    bool is_hosting() const { return hosting; }
+};
@@ -8,21 +8,40 @@
 
 void mmap_file::open(const std::filesystem::path& path)
 {
-    int fd = ::open(path.c_str(), O_RDONLY);
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
     if (fd < 0)
         throw std::system_error(errno, std::system_category());
     struct stat s;
     if (fstat(fd, &s) < 0)
-        throw std::system_error(errno, std::system_category());
+    {
+        int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::system_category());
+    }
 
     len = s.st_size;
-    if (!(data = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0)))
-        throw std::system_error(errno, std::system_category());
+    data = nullptr;
+
+    // mmap refuses zero-length mappings, an empty file is just an empty buffer
+    if (len != 0)
+    {
+        void* ptr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED)
+        {
+            int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::system_category());
+        }
+        data = ptr;
+    }
+
+    // the mapping holds its own reference to the file
+    ::close(fd);
 }
 
 void mmap_file::close()
 {
     if (is_open())
         munmap(data, len);
+    data = nullptr;
 }
-
@@ -5,8 +5,8 @@
 
 class mmap_file
 {
-    void* data;
-    size_t len;
+    void* data = nullptr;
+    size_t len = 0;
 
 public:
     inline mmap_file(const std::filesystem::path& path) { open(path); }
@@ -15,8 +15,11 @@ public:
     void open(const std::filesystem::path& path);
     void close();
 
-    constexpr bool is_open() const { return data == nullptr; }
-    constexpr operator bool() const { return data == nullptr; }
+    mmap_file(const mmap_file&) = delete;
+    mmap_file& operator=(const mmap_file&) = delete;
+
+    constexpr bool is_open() const { return data != nullptr; }
+    constexpr operator bool() const { return data != nullptr; }
 
     constexpr std::span<uint8_t> buffer() const { return std::span((uint8_t*)data, len); }
 };
@@ -0,0 +1,145 @@
+#include "process.h"
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <string_view>
+#include <system_error>
+#include <unordered_set>
+#include <unistd.h>
+
+environment_block::environment_block(const std::unordered_map<std::string, std::string>& overrides)
+{
+    // seen holds views into strings, which therefore must never reallocate
+    size_t environ_size = 0;
+    for (auto curr_env = environ; *curr_env; curr_env++)
+        environ_size++;
+    strings.reserve(environ_size + overrides.size());
+
+    std::unordered_set<std::string_view> seen;
+    for (const auto& i : overrides)
+        seen.insert(i.first);
+
+    // copy current environ, skipping overridden keys and any duplicate after the first (which is the one getenv reports)
+    for (auto curr_env = environ; *curr_env; curr_env++)
+    {
+        source.push_back(*curr_env);
+        std::string_view entry(*curr_env);
+        auto key = entry.substr(0, entry.find('='));
+        if (seen.contains(key))
+            continue;
+        strings.emplace_back(entry);
+        seen.insert(std::string_view(strings.back()).substr(0, key.size()));
+    }
+
+    // overrides in a fixed order, so the same overrides always produce the same block
+    std::vector<const std::pair<const std::string, std::string>*> sorted;
+    for (const auto& i : overrides)
+        sorted.push_back(&i);
+    std::sort(sorted.begin(), sorted.end(), [](auto a, auto b) { return a->first < b->first; });
+    for (auto i : sorted)
+        strings.push_back(i->first + "=" + i->second);
+
+    // pointers are only taken once strings has stopped growing
+    for (auto& i : strings)
+        envp.push_back(i.data());
+    envp.push_back(nullptr);
+}
+
+bool environment_block::current() const
+{
+    // setenv and putenv install a new string for every variable they touch, and unsetenv moves the ones after it, so an environment that
+    // changed never has the same entries in the same order
+    size_t i = 0;
+    for (auto curr_env = environ; *curr_env; curr_env++, i++)
+    {
+        if (i == source.size() || source[i] != *curr_env)
+            return false;
+    }
+    return i == source.size();
+}
+
+std::shared_ptr<const environment_block> environment_block::of(const std::unordered_map<std::string, std::string>& overrides)
+{
+    static std::mutex mtx;
+    static std::shared_ptr<const environment_block> plain;
+    static std::map<std::map<std::string, std::string>, std::shared_ptr<const environment_block>> cache;
+
+    std::lock_guard g(mtx);
+    // the common case, no overrides at all, skips the cache lookup entirely
+    if (overrides.empty())
+    {
+        if (!plain || !plain->current())
+            plain = std::make_shared<const environment_block>(overrides);
+        return plain;
+    }
+
+    auto& entry = cache[std::map<std::string, std::string>(overrides.begin(), overrides.end())];
+    if (!entry || !entry->current())
+        entry = std::make_shared<const environment_block>(overrides);
+    return entry;
+}
+
+pid_t spawn_process(const std::filesystem::path& path, const std::vector<std::string>& args, const environment_block& env, int out_fd,
+                    int err_fd, bool own_group)
+{
+    // set up argv
+    std::string a0 = path.string();
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(a0.c_str()));
+    for (const auto& i : args)
+        argv.push_back(const_cast<char*>(i.c_str()));
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (out_fd >= 0)
+        posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+    if (err_fd >= 0)
+        posix_spawn_file_actions_adddup2(&actions, err_fd, STDERR_FILENO);
+
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    if (own_group)
+    {
+        posix_spawnattr_setpgroup(&attr, 0);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+    }
+
+    pid_t pid;
+    int err = posix_spawn(&pid, a0.c_str(), &actions, &attr, argv.data(), env.get());
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    if (err != 0)
+        throw std::system_error(err, std::system_category());
+    return pid;
+}
+
+static std::chrono::microseconds to_duration(const timeval& tv) { return std::chrono::seconds(tv.tv_sec) + std::chrono::microseconds(tv.tv_usec); }
+
+std::optional<metabuild::program_result> reap_process(pid_t pid, std::chrono::steady_clock::time_point started, bool block)
+{
+    int status;
+    rusage ru;
+    pid_t reaped;
+    while ((reaped = wait4(pid, &status, block ? 0 : WNOHANG, &ru)) == -1)
+    {
+        if (errno != EINTR)
+            throw std::system_error(errno, std::system_category());
+    }
+
+    if (reaped == 0)
+        return std::nullopt;
+
+    metabuild::resource_usage usage;
+    usage.user_time = to_duration(ru.ru_utime);
+    usage.system_time = to_duration(ru.ru_stime);
+    usage.wall_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
+    usage.max_rss = ru.ru_maxrss;
+    usage.minor_faults = ru.ru_minflt;
+    usage.major_faults = ru.ru_majflt;
+    return metabuild::program_result(status, usage);
+}
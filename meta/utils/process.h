@@ -0,0 +1,46 @@
+#pragma once
+#include <chrono>
+#include <command.h>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+// an immutable envp: the current environment with a set of overrides applied, every key appearing exactly once
+class environment_block
+{
+    std::vector<std::string> strings;
+    std::vector<char*> envp;
+    // the entries of environ the block was built from
+    std::vector<const char*> source;
+
+    // whether environ still holds exactly those entries
+    bool current() const;
+
+public:
+    environment_block(const std::unordered_map<std::string, std::string>& overrides);
+    environment_block(const environment_block&) = delete;
+    environment_block& operator=(const environment_block&) = delete;
+
+    char* const* get() const { return envp.data(); }
+
+    // blocks are built once per distinct set of overrides and shared by every launch that uses them, until environ changes: a block
+    // requested after setenv, putenv or unsetenv is rebuilt, so every launch sees the live environment
+    static std::shared_ptr<const environment_block> of(const std::unordered_map<std::string, std::string>& overrides);
+};
+
+// launches a program through posix_spawn, which glibc implements with clone(CLONE_VM | CLONE_VFORK); unlike fork() this does not
+// copy our page tables, so the cost of a launch does not grow with the size of the build process
+// stdout/stderr are redirected to out_fd/err_fd when those are >= 0; with own_group the child leads a new process group, so killpg() on its
+// pid reaches everything it started
+// throws std::system_error if the program cannot be started
+pid_t spawn_process(const std::filesystem::path& path, const std::vector<std::string>& args, const environment_block& env, int out_fd = -1,
+                    int err_fd = -1, bool own_group = false);
+
+// reaps pid through wait4, retrying on EINTR, and measures its wall time from started; without block, returns nullopt while the child is
+// still running
+// throws std::system_error
+std::optional<metabuild::program_result> reap_process(pid_t pid, std::chrono::steady_clock::time_point started, bool block = true);
@@ -0,0 +1,555 @@
+#include "process_reactor.h"
+#include "process.h"
+#include "sysinfo.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <fcntl.h>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <unistd.h>
+
+inline static constexpr size_t PIPE_READ_SIZE = 64 * 1024;
+inline static constexpr int MAX_EVENTS = 64;
+// how long to wait before sampling MemAvailable again while a job is held back by it
+inline static constexpr int MEMORY_RECHECK_MS = 250;
+// in adaptive mode, how often pressure is sampled and which fraction of wall time spent stalled we try to stay under
+inline static constexpr int PRESSURE_SAMPLE_MS = 500;
+inline static constexpr double PRESSURE_STALL_TARGET = 0.1;
+inline static constexpr const char* PRESSURE_RESOURCES[] = {"cpu", "memory", "io"};
+// how long a cancelled job gets to exit after SIGTERM before it is sent SIGKILL
+inline static constexpr int KILL_GRACE_MS = 1000;
+
+// the reactor listening for signals, reached from the handler through its eventfd, which is async-signal-safe to write to
+static std::atomic<int> signal_wake_fd{-1};
+static std::atomic<bool> signal_received{false};
+static struct sigaction previous_sigint;
+static struct sigaction previous_sigterm;
+
+static void on_signal(int)
+{
+    signal_received = true;
+    int fd = signal_wake_fd.load();
+    uint64_t one = 1;
+    if (fd >= 0)
+        (void)!write(fd, &one, sizeof(one));
+}
+
+struct process_reactor::running_job
+{
+    pid_t pid = -1;
+    long reserved = 0;
+    std::chrono::steady_clock::time_point started;
+    int pidfd = -1;
+    int out_fd = -1;
+    int err_fd = -1;
+    bool exited = false;
+    process_output output;
+    completion done;
+    std::function<void(std::string_view)> on_err;
+
+    bool finished() const { return exited && out_fd < 0 && err_fd < 0; }
+};
+
+static int pidfd_open(pid_t pid) { return syscall(SYS_pidfd_open, pid, 0); }
+
+static void throw_errno() { throw std::system_error(errno, std::system_category()); }
+
+process_reactor::process_reactor(size_t max_jobs, long memory_budget)
+    : max_jobs(max_jobs ? max_jobs : 1), job_limit(this->max_jobs), memory_budget(memory_budget)
+{
+    if (!this->memory_budget)
+        this->memory_budget = mem_available().value_or(0);
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0)
+        throw_errno();
+
+    wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wake_fd < 0)
+        throw_errno();
+
+    // the wake fd is tagged with a null pointer, every other fd with the job it belongs to
+    epoll_event ev{EPOLLIN, {.ptr = nullptr}};
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) < 0)
+        throw_errno();
+
+    worker = std::thread([this] { run(); });
+}
+
+process_reactor::~process_reactor()
+{
+    wait();
+    {
+        std::lock_guard g(mtx);
+        stopping = true;
+    }
+    wake();
+    worker.join();
+
+    if (catching_signals)
+    {
+        sigaction(SIGINT, &previous_sigint, nullptr);
+        sigaction(SIGTERM, &previous_sigterm, nullptr);
+        signal_wake_fd = -1;
+    }
+
+    close(wake_fd);
+    close(epoll_fd);
+}
+
+void process_reactor::wake()
+{
+    uint64_t one = 1;
+    (void)!write(wake_fd, &one, sizeof(one));
+}
+
+void process_reactor::submit(process_request request, completion done)
+{
+    {
+        std::lock_guard g(mtx);
+        // ahead of lower priorities, behind equal ones; a job already held back for memory keeps its place, it would starve otherwise
+        auto it = queue.end();
+        while (it != queue.begin() && std::prev(it)->request.priority < request.priority && !std::prev(it)->bypassed)
+            it--;
+        queue.insert(it, {std::move(request), std::move(done)});
+        active++;
+    }
+    wake();
+}
+
+std::future<process_output> process_reactor::submit(process_request request)
+{
+    auto promise = std::make_shared<std::promise<process_output>>();
+    auto future = promise->get_future();
+    submit(std::move(request), [promise](process_output output) { promise->set_value(std::move(output)); });
+    return future;
+}
+
+void process_reactor::adapt_to_pressure(size_t initial_jobs)
+{
+    {
+        std::lock_guard g(mtx);
+        adaptive = true;
+        job_limit = std::clamp<size_t>(initial_jobs, 1, max_jobs);
+    }
+    wake();
+}
+
+void process_reactor::use_jobserver(jobserver& js)
+{
+    {
+        std::lock_guard g(mtx);
+        tokens = &js;
+    }
+    wake();
+}
+
+void process_reactor::cancel()
+{
+    {
+        std::lock_guard g(mtx);
+        cancelled = true;
+    }
+    wake();
+}
+
+void process_reactor::cancel_on_signal()
+{
+    signal_received = false;
+    signal_wake_fd = wake_fd;
+
+    struct sigaction action = {};
+    action.sa_handler = on_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &action, &previous_sigint);
+    sigaction(SIGTERM, &action, &previous_sigterm);
+
+    std::lock_guard g(mtx);
+    catching_signals = true;
+}
+
+bool process_reactor::interrupted() const { return catching_signals && signal_received; }
+
+void process_reactor::wait()
+{
+    std::unique_lock g(mtx);
+    idle_cv.wait(g, [this] { return active == 0; });
+}
+
+void process_reactor::run()
+{
+    std::unordered_map<running_job*, std::unique_ptr<running_job>> running;
+    // sum of the predictions of every running job, and the largest peak seen so far, which stands in for jobs without a prediction
+    long committed = 0;
+    long observed_peak = 0;
+
+    // jobserver tokens held for running jobs beyond the first; while one is wanted its fd sits in the epoll set, tagged with token_tag
+    size_t tokens_held = 0;
+    bool token_fd_registered = false;
+    static char token_tag;
+    std::unique_ptr<char[]> buf(new char[PIPE_READ_SIZE]);
+
+    auto unregister = [&](int& fd) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        fd = -1;
+    };
+
+    auto complete = [&](running_job* job) {
+        auto owned = std::move(running[job]);
+        running.erase(job);
+        committed -= owned->reserved;
+        observed_peak = std::max(observed_peak, owned->output.status.get_usage().max_rss);
+        owned->done(std::move(owned->output));
+
+        std::lock_guard g(mtx);
+        if (--active == 0)
+            idle_cv.notify_all();
+    };
+
+    auto complete_unstarted = [&](pending_job& job, process_output output) {
+        job.done(std::move(output));
+
+        std::lock_guard g(mtx);
+        if (--active == 0)
+            idle_cv.notify_all();
+    };
+
+    // a job that cannot even be started still completes, with the same status a failed exec used to give
+    auto fail = [&](pending_job& job, const std::string& what) {
+        process_output output;
+        output.status = 127 << 8;
+        output.err = what;
+        complete_unstarted(job, std::move(output));
+    };
+
+    // once cancelled, running jobs get SIGTERM and then, after the grace period, SIGKILL; queued ones never start
+    bool cancelling = false;
+    bool kill_pending = false;
+    auto kill_deadline = std::chrono::steady_clock::now();
+    auto handle_cancel = [&]() {
+        std::deque<pending_job> dropped;
+        {
+            std::lock_guard g(mtx);
+            if (signal_received && catching_signals)
+                cancelled = true;
+            if (!cancelled)
+                return;
+            dropped.swap(queue);
+        }
+
+        for (auto& i : dropped)
+        {
+            process_output output;
+            output.status = SIGTERM;
+            output.cancelled = true;
+            complete_unstarted(i, std::move(output));
+        }
+
+        if (!cancelling)
+        {
+            cancelling = true;
+            kill_pending = true;
+            kill_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(KILL_GRACE_MS);
+            for (auto& [ptr, job] : running)
+            {
+                if (job->exited)
+                    continue;
+                job->output.cancelled = true;
+                killpg(job->pid, SIGTERM);
+            }
+        }
+        else if (kill_pending && std::chrono::steady_clock::now() >= kill_deadline)
+        {
+            kill_pending = false;
+            for (auto& [ptr, job] : running)
+                if (!job->exited)
+                    killpg(job->pid, SIGKILL);
+        }
+    };
+
+    auto start = [&](pending_job& next, long reserved) {
+        int out_pipe[2];
+        int err_pipe[2];
+        if (pipe2(out_pipe, O_CLOEXEC) < 0)
+            return fail(next, "pipe: " + std::system_category().message(errno));
+        if (pipe2(err_pipe, O_CLOEXEC) < 0)
+        {
+            close(out_pipe[0]);
+            close(out_pipe[1]);
+            return fail(next, "pipe: " + std::system_category().message(errno));
+        }
+
+        auto job = std::make_unique<running_job>();
+        job->done = std::move(next.done);
+        job->on_err = std::move(next.request.on_err);
+        job->reserved = reserved;
+
+        try
+        {
+            job->started = std::chrono::steady_clock::now();
+            job->pid = spawn_process(next.request.path, next.request.args, *next.request.env, out_pipe[1], err_pipe[1], true);
+        }
+        catch (const std::system_error& e)
+        {
+            for (int fd : {out_pipe[0], out_pipe[1], err_pipe[0], err_pipe[1]})
+                close(fd);
+            next.done = std::move(job->done);
+            return fail(next, next.request.path.string() + ": " + e.what());
+        }
+
+        close(out_pipe[1]);
+        close(err_pipe[1]);
+
+        // only our ends are non-blocking, the child keeps ordinary blocking pipes
+        job->out_fd = out_pipe[0];
+        job->err_fd = err_pipe[0];
+        fcntl(job->out_fd, F_SETFL, O_NONBLOCK);
+        fcntl(job->err_fd, F_SETFL, O_NONBLOCK);
+
+        // without pidfd support (pre-5.3 kernels) the child is reaped once both pipes hit eof instead
+        job->pidfd = pidfd_open(job->pid);
+
+        auto* ptr = job.get();
+        for (int fd : {job->pidfd, job->out_fd, job->err_fd})
+        {
+            if (fd < 0)
+                continue;
+            epoll_event ev{EPOLLIN, {.ptr = ptr}};
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+                throw_errno();
+        }
+
+        running[ptr] = std::move(job);
+        committed += reserved;
+    };
+
+    // returns false once the pipe hits eof
+    auto drain = [&](int fd, std::string& sink, const std::function<void(std::string_view)>& on_data = nullptr) {
+        while (true)
+        {
+            auto n = read(fd, buf.get(), PIPE_READ_SIZE);
+            if (n > 0)
+            {
+                sink.append(buf.get(), n);
+                if (on_data)
+                    on_data(std::string_view(buf.get(), n));
+            }
+            else if (n == 0)
+                return false;
+            else if (errno == EINTR)
+                continue;
+            else if (errno == EAGAIN)
+                return true;
+            else
+                return false;
+        }
+    };
+
+    using clock = std::chrono::steady_clock;
+    auto next_sample = clock::now();
+    clock::time_point last_sample;
+    std::optional<uint64_t> last_stall[std::size(PRESSURE_RESOURCES)];
+
+    // additive increase, multiplicative decrease, like tcp: back off quickly once something stalls and probe upwards slowly
+    auto sample_pressure = [&]() {
+        auto now = clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - last_sample).count();
+        double stalled = 0;
+        bool have_delta = false;
+        for (size_t i = 0; i < std::size(PRESSURE_RESOURCES); i++)
+        {
+            auto total = pressure_stall_us(PRESSURE_RESOURCES[i]);
+            if (total && last_stall[i] && elapsed > 0)
+            {
+                stalled = std::max(stalled, double(total.value() - last_stall[i].value()) / elapsed);
+                have_delta = true;
+            }
+            last_stall[i] = total;
+        }
+        last_sample = now;
+        next_sample = now + std::chrono::milliseconds(PRESSURE_SAMPLE_MS);
+
+        if (!have_delta)
+            return;
+
+        std::lock_guard g(mtx);
+        if (stalled > PRESSURE_STALL_TARGET)
+            job_limit = std::max<size_t>(1, job_limit * 3 / 4);
+        else if (stalled < PRESSURE_STALL_TARGET / 2 && !queue.empty() && running.size() >= job_limit)
+            job_limit = std::min(max_jobs, job_limit + 1);
+    };
+
+    epoll_event events[MAX_EVENTS];
+
+    while (true)
+    {
+        handle_cancel();
+
+        // launch whatever fits into the free slots and the memory budget
+        bool held_back = false;
+        bool token_wanted = false;
+        std::optional<long> available;
+        while (true)
+        {
+            pending_job next;
+            long reserved = 0;
+            {
+                std::lock_guard g(mtx);
+                if (cancelled || queue.empty() || running.size() >= job_limit)
+                    break;
+
+                if (tokens && !running.empty() && running.size() > tokens_held)
+                {
+                    if (!tokens->try_acquire())
+                    {
+                        token_wanted = true;
+                        break;
+                    }
+                    tokens_held++;
+                }
+
+                // with nothing running a job always starts, however heavy, so the build cannot stall
+                auto fits = [&](const pending_job& job) {
+                    long predicted = job.request.predicted_rss ? job.request.predicted_rss : observed_peak;
+                    if (running.empty() || !predicted)
+                        return true;
+                    if (memory_budget && committed + predicted > memory_budget)
+                        return false;
+                    if (!available)
+                        available = mem_available().value_or(LONG_MAX);
+                    return predicted <= available.value();
+                };
+
+                // lighter jobs may overtake a heavy one to keep cores busy, but only a bounded number of times, after which it waits
+                // for room at the head of the queue
+                auto it = queue.begin();
+                while (it != queue.end() && !fits(*it))
+                {
+                    if (it->bypassed >= max_jobs)
+                    {
+                        it = queue.end();
+                        break;
+                    }
+                    it++;
+                }
+
+                if (it == queue.end())
+                {
+                    held_back = true;
+                    break;
+                }
+
+                for (auto j = queue.begin(); j != it; j++)
+                    j->bypassed++;
+
+                next = std::move(*it);
+                queue.erase(it);
+                reserved = next.request.predicted_rss ? next.request.predicted_rss : observed_peak;
+            }
+
+            // later candidates in this round have to fit around what was just reserved
+            if (available)
+                available = available.value() - reserved;
+            start(next, reserved);
+        }
+
+        // hand back tokens no running job needs, whether freed by a completion or taken for a job that was then held back
+        while (tokens_held > (running.empty() ? 0 : running.size() - 1))
+        {
+            tokens->release();
+            tokens_held--;
+        }
+
+        if (token_wanted != token_fd_registered)
+        {
+            epoll_event ev{EPOLLIN, {.ptr = &token_tag}};
+            if (epoll_ctl(epoll_fd, token_wanted ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, tokens->fd(), &ev) < 0)
+                throw_errno();
+            token_fd_registered = token_wanted;
+        }
+
+        bool sampling;
+        {
+            std::lock_guard g(mtx);
+            if (stopping && running.empty() && queue.empty())
+                return;
+            sampling = adaptive && !(running.empty() && queue.empty());
+        }
+
+        // a completion frees memory and wakes us anyway, the timeout is for memory freed by whatever else runs on the machine
+        int timeout = held_back ? MEMORY_RECHECK_MS : -1;
+        if (sampling)
+        {
+            auto until_sample = std::chrono::duration_cast<std::chrono::milliseconds>(next_sample - clock::now()).count();
+            until_sample = std::max<long>(until_sample, 0);
+            timeout = timeout < 0 ? until_sample : std::min<long>(timeout, until_sample);
+        }
+
+        if (kill_pending)
+        {
+            auto until_kill = std::chrono::duration_cast<std::chrono::milliseconds>(kill_deadline - clock::now()).count();
+            until_kill = std::max<long>(until_kill, 0);
+            timeout = timeout < 0 ? until_kill : std::min<long>(timeout, until_kill);
+        }
+
+        int count = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+        if (sampling && clock::now() >= next_sample)
+            sample_pressure();
+
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw_errno();
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            if (events[i].data.ptr == &token_tag)
+                continue;
+
+            auto* job = (running_job*)events[i].data.ptr;
+            if (!job)
+            {
+                uint64_t discard;
+                (void)!read(wake_fd, &discard, sizeof(discard));
+                continue;
+            }
+
+            // a job may have been completed earlier in this batch
+            if (!running.contains(job))
+                continue;
+
+            if (job->out_fd >= 0 && !drain(job->out_fd, job->output.out))
+                unregister(job->out_fd);
+            if (job->err_fd >= 0 && !drain(job->err_fd, job->output.err, job->on_err))
+                unregister(job->err_fd);
+
+            if (!job->exited)
+            {
+                // the pidfd turns readable once the child has exited, so this only blocks in the fallback path
+                bool block = job->pidfd < 0 && job->out_fd < 0 && job->err_fd < 0;
+                if (auto result = reap_process(job->pid, job->started, block))
+                {
+                    job->exited = true;
+                    job->output.status = result.value();
+                    if (job->pidfd >= 0)
+                        unregister(job->pidfd);
+                }
+            }
+
+            if (job->finished())
+                complete(job);
+        }
+    }
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include "jobserver.h"
+#include "process.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+struct process_request
+{
+    std::filesystem::path path;
+    std::vector<std::string> args;
+    // shared, so queuing a job never copies the environment
+    std::shared_ptr<const environment_block> env = environment_block::of({});
+    // expected peak resident set in kilobytes, 0 when unknown
+    long predicted_rss = 0;
+    // queued jobs start highest first, in submission order among equals
+    int64_t priority = 0;
+    // called on the reactor thread with stderr as it arrives, in whatever chunks the pipe yields; it is still collected in full as well
+    std::function<void(std::string_view)> on_err;
+};
+
+struct process_output
+{
+    // wait status and resource usage
+    metabuild::program_result status;
+    std::string out;
+    std::string err;
+    // the job was killed, or never started, because the reactor was cancelled
+    bool cancelled = false;
+};
+
+// supervises child processes from a single thread: every running child is a pidfd plus its two output pipes in one epoll set, so the
+// number of concurrent jobs is bounded by max_jobs rather than by how many threads are parked in waitpid
+// jobs are also admitted against memory: the predicted peaks of everything running must stay within the budget, and a job is held back
+// while MemAvailable cannot cover its own prediction
+// every job leads its own process group, which is what cancel() kills
+// with a jobserver, running a job beyond the first takes one of its tokens, so the limit is shared with make and nested builds
+// in adaptive mode the job limit itself moves with the machine's pressure stall information, shrinking when tasks stall on cpu, memory or
+// io and growing back while they do not
+class process_reactor
+{
+public:
+    using completion = std::function<void(process_output)>;
+
+private:
+    struct pending_job
+    {
+        process_request request;
+        completion done;
+        // how often a lighter job was started ahead of this one
+        size_t bypassed = 0;
+    };
+
+    struct running_job;
+
+    std::mutex mtx;
+    std::condition_variable idle_cv;
+    std::deque<pending_job> queue;
+    size_t max_jobs;
+    size_t job_limit;
+    bool adaptive = false;
+    long memory_budget;
+    jobserver* tokens = nullptr;
+    size_t active = 0;
+    bool stopping = false;
+    bool cancelled = false;
+    // read by interrupted() from any thread
+    std::atomic<bool> catching_signals = false;
+
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    std::thread worker;
+
+    void run();
+    void wake();
+
+public:
+    // memory_budget is in kilobytes, 0 takes MemAvailable at construction
+    process_reactor(size_t max_jobs, long memory_budget = 0);
+    // waits for every submitted job to complete
+    ~process_reactor();
+
+    process_reactor(const process_reactor&) = delete;
+    process_reactor& operator=(const process_reactor&) = delete;
+
+    // queues a process, started as soon as a job slot frees up and nothing of higher priority is waiting; the completion runs on the reactor thread, so it should hand any real
+    // work off elsewhere
+    void submit(process_request request, completion done);
+    std::future<process_output> submit(process_request request);
+
+    // lets pressure steer the job limit between 1 and max_jobs, starting from initial_jobs; without /proc/pressure it stays there
+    void adapt_to_pressure(size_t initial_jobs);
+
+    // every job past the first then also holds a token of this jobserver while it runs
+    void use_jobserver(jobserver& js);
+
+    // terminates the process group of every running job and completes everything queued, or submitted later, without starting it; either
+    // way the output is marked cancelled. callable from any thread, completions included
+    void cancel();
+    // makes SIGINT and SIGTERM cancel the reactor for as long as it lives
+    void cancel_on_signal();
+    // whether a signal caused the cancellation
+    bool interrupted() const;
+
+    // blocks until nothing is queued or running
+    void wait();
+};
@@ -0,0 +1,273 @@
+#include "sha256.h"
+#include <algorithm>
+#include <numeric>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define SHA_HAS_X86
+#endif
+
+#ifdef SHA_HAS_X86
+static bool cpu_has(unsigned leaf, unsigned reg, unsigned bit)
+{
+    unsigned regs[4];
+    if (!__get_cpuid_count(leaf, 0, &regs[0], &regs[1], &regs[2], &regs[3]))
+        return false;
+    return regs[reg] & (1u << bit);
+}
+
+bool sha::has_shani()
+{
+    // sha-ni needs ssse3 and sse4.1 for the byte shuffles and blends around it
+    static const bool value = cpu_has(7, 1, 29) && cpu_has(1, 2, 9) && cpu_has(1, 2, 19);
+    return value;
+}
+
+bool sha::has_avx2()
+{
+    // the os also has to be saving the ymm registers, which xgetbv tells us
+    static const bool value = [] {
+        if (!cpu_has(1, 2, 27) || !cpu_has(1, 2, 28) || !cpu_has(7, 1, 5))
+            return false;
+        unsigned lo, hi;
+        __asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        return (lo & 6) == 6;
+    }();
+    return value;
+}
+
+[[gnu::target("sha,sse4.1,ssse3")]] void sha::transform_shani(uint32_t* hash_data, const uint8_t* message, size_t blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // the sha instructions want the state as ABEF/CDGH
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&hash_data[0]), 0xb1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&hash_data[4]), 0x1b);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+    for (size_t i = 0; i < blocks; i++, message += BLOCK_SIZE)
+    {
+        __m128i abef = state0;
+        __m128i cdgh = state1;
+        __m128i w[4];
+
+        // each iteration does four rounds; the schedule for later rounds is built in a ring of four registers as we go
+        for (int j = 0; j < 16; j++)
+        {
+            if (j < 4)
+                w[j] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(message + j * 16)), mask);
+
+            __m128i msg = _mm_add_epi32(w[j % 4], _mm_loadu_si128((const __m128i*)&sha256_k[j * 4]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+
+            if (j >= 3 && j <= 14)
+            {
+                w[(j + 1) % 4] = _mm_add_epi32(w[(j + 1) % 4], _mm_alignr_epi8(w[j % 4], w[(j + 3) % 4], 4));
+                w[(j + 1) % 4] = _mm_sha256msg2_epu32(w[(j + 1) % 4], w[j % 4]);
+            }
+
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));
+
+            if (j >= 1 && j <= 12)
+                w[(j + 3) % 4] = _mm_sha256msg1_epu32(w[(j + 3) % 4], w[j % 4]);
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1b);
+    state1 = _mm_shuffle_epi32(state1, 0xb1);
+    _mm_storeu_si128((__m128i*)&hash_data[0], _mm_blend_epi16(tmp, state1, 0xf0));
+    _mm_storeu_si128((__m128i*)&hash_data[4], _mm_alignr_epi8(state1, tmp, 8));
+}
+
+#define AVX_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+// transposes eight rows of eight 32-bit words, so that row i ends up holding word i of every input
+[[gnu::target("avx2")]] static void transpose_8x8(__m256i* r)
+{
+    __m256i t[8];
+    __m256i u[8];
+    for (int i = 0; i < 8; i += 2)
+    {
+        t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+    }
+    for (int i = 0; i < 8; i += 4)
+    {
+        u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+        u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+        u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        r[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+        r[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+    }
+}
+
+[[gnu::target("avx2")]] void sha::transform_avx2_x8(uint32_t (*hash_data)[8], const uint8_t* const* message)
+{
+    const __m256i bswap = _mm256_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL, 0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m256i w[64];
+    for (int half = 0; half < 2; half++)
+    {
+        for (int lane = 0; lane < 8; lane++)
+            w[half * 8 + lane] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(message[lane] + half * 32)), bswap);
+        transpose_8x8(&w[half * 8]);
+    }
+
+    for (int j = 16; j < 64; j++)
+    {
+        __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(AVX_ROTR(w[j - 15], 7), AVX_ROTR(w[j - 15], 18)), _mm256_srli_epi32(w[j - 15], 3));
+        __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(AVX_ROTR(w[j - 2], 17), AVX_ROTR(w[j - 2], 19)), _mm256_srli_epi32(w[j - 2], 10));
+        w[j] = _mm256_add_epi32(_mm256_add_epi32(s1, w[j - 7]), _mm256_add_epi32(s0, w[j - 16]));
+    }
+
+    __m256i v[8];
+    for (int j = 0; j < 8; j++)
+        v[j] = _mm256_loadu_si256((const __m256i*)hash_data[j]);
+
+    for (int j = 0; j < 64; j++)
+    {
+        __m256i f2 = _mm256_xor_si256(_mm256_xor_si256(AVX_ROTR(v[4], 6), AVX_ROTR(v[4], 11)), AVX_ROTR(v[4], 25));
+        __m256i ch = _mm256_xor_si256(_mm256_and_si256(v[4], v[5]), _mm256_andnot_si256(v[4], v[6]));
+        __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(v[7], f2), _mm256_add_epi32(ch, _mm256_add_epi32(_mm256_set1_epi32(sha256_k[j]), w[j])));
+        __m256i f1 = _mm256_xor_si256(_mm256_xor_si256(AVX_ROTR(v[0], 2), AVX_ROTR(v[0], 13)), AVX_ROTR(v[0], 22));
+        __m256i maj = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(v[0], v[1]), _mm256_and_si256(v[0], v[2])), _mm256_and_si256(v[1], v[2]));
+        __m256i t2 = _mm256_add_epi32(f1, maj);
+        v[7] = v[6];
+        v[6] = v[5];
+        v[5] = v[4];
+        v[4] = _mm256_add_epi32(v[3], t1);
+        v[3] = v[2];
+        v[2] = v[1];
+        v[1] = v[0];
+        v[0] = _mm256_add_epi32(t1, t2);
+    }
+
+    for (int j = 0; j < 8; j++)
+        _mm256_storeu_si256((__m256i*)hash_data[j], _mm256_add_epi32(v[j], _mm256_loadu_si256((const __m256i*)hash_data[j])));
+}
+
+#undef AVX_ROTR
+#else
+bool sha::has_shani() { return false; }
+bool sha::has_avx2() { return false; }
+void sha::transform_shani(uint32_t*, const uint8_t*, size_t) { __builtin_trap(); }
+void sha::transform_avx2_x8(uint32_t (*)[8], const uint8_t* const*) { __builtin_trap(); }
+#endif
+
+sha::transform_fn sha::select_transform()
+{
+    if (has_shani())
+        return transform_shani;
+    return transform_portable;
+}
+
+void sha::transform_dispatch(uint32_t* hash_data, const uint8_t* message, size_t blocks)
+{
+    static const transform_fn fn = select_transform();
+    fn(hash_data, message, blocks);
+}
+
+std::vector<std::string> sha::digest_str_many(const std::vector<std::span<uint8_t>>& bufs)
+{
+    std::vector<std::string> out(bufs.size());
+
+    // a single sha-ni stream beats eight avx2 lanes, so multi-buffer is only worth it without sha-ni
+    if (has_shani() || !has_avx2() || bufs.size() < 2)
+    {
+        for (size_t i = 0; i < bufs.size(); i++)
+        {
+            sha s;
+            s.update(bufs[i]);
+            out[i] = s.digest_str();
+        }
+        return out;
+    }
+
+    // group buffers of similar size so the lanes of a group finish around the same time
+    std::vector<size_t> order(bufs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return bufs[a].size() > bufs[b].size(); });
+
+    static const uint8_t idle_block[BLOCK_SIZE] = {};
+
+    for (size_t group = 0; group < order.size(); group += 8)
+    {
+        size_t lanes = std::min<size_t>(8, order.size() - group);
+
+        // per lane: the whole blocks are read straight from the input, the padded tail lives in its own buffer
+        uint8_t tails[8][2 * BLOCK_SIZE] = {};
+        size_t full_blocks[8] = {};
+        size_t total_blocks[8] = {};
+        size_t max_blocks = 0;
+
+        for (size_t lane = 0; lane < lanes; lane++)
+        {
+            const auto& buf = bufs[order[group + lane]];
+            size_t rem = buf.size() % BLOCK_SIZE;
+            uint64_t len_b = (uint64_t)buf.size() << 3;
+
+            full_blocks[lane] = buf.size() / BLOCK_SIZE;
+            size_t tail_blocks = rem + 9 > BLOCK_SIZE ? 2 : 1;
+            total_blocks[lane] = full_blocks[lane] + tail_blocks;
+            max_blocks = std::max(max_blocks, total_blocks[lane]);
+
+            memcpy(tails[lane], buf.data() + full_blocks[lane] * BLOCK_SIZE, rem);
+            tails[lane][rem] = 0x80;
+            uint8_t* len_pos = tails[lane] + tail_blocks * BLOCK_SIZE - 8;
+            SHA2_UNPACK32((uint32_t)(len_b >> 32), len_pos);
+            SHA2_UNPACK32((uint32_t)len_b, len_pos + 4);
+        }
+
+        // [word][lane], so each word loads straight into one register
+        uint32_t state[8][8];
+        sha init;
+        for (int word = 0; word < 8; word++)
+            for (int lane = 0; lane < 8; lane++)
+                state[word][lane] = init.hash_data[word];
+
+        for (size_t block = 0; block < max_blocks; block++)
+        {
+            const uint8_t* ptrs[8];
+            uint32_t saved[8][8];
+            memcpy(saved, state, sizeof(state));
+
+            for (size_t lane = 0; lane < 8; lane++)
+            {
+                if (lane >= lanes || block >= total_blocks[lane])
+                    ptrs[lane] = idle_block;
+                else if (block < full_blocks[lane])
+                    ptrs[lane] = bufs[order[group + lane]].data() + block * BLOCK_SIZE;
+                else
+                    ptrs[lane] = tails[lane] + (block - full_blocks[lane]) * BLOCK_SIZE;
+            }
+
+            transform_avx2_x8(state, ptrs);
+
+            // lanes that have already finished just ran over a dummy block, put their result back
+            for (size_t lane = 0; lane < 8; lane++)
+            {
+                if (lane >= lanes || block >= total_blocks[lane])
+                    for (int word = 0; word < 8; word++)
+                        state[word][lane] = saved[word][lane];
+            }
+        }
+
+        for (size_t lane = 0; lane < lanes; lane++)
+        {
+            std::string& str = out[order[group + lane]];
+            for (int word = 0; word < 8; word++)
+                str += fmt::format("{:08x}", state[word][lane]);
+        }
+    }
+
+    return out;
+}
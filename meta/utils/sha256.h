@@ -58,7 +58,10 @@ class sha
             return memcpy(destination, source, num);
         }
     }
-    constexpr void transform(const uint8_t* message, uint32_t blocks)
+
+public:
+    // the reference implementation, used during constant evaluation and on cpus without any of the accelerated paths
+    static constexpr void transform_portable(uint32_t* hash_data, const uint8_t* message, size_t blocks)
     {
         uint32_t w[64];
         uint32_t wv[8];
@@ -101,7 +104,26 @@ class sha
         }
     }
 
-    uint32_t tot_len;
+    // accelerated paths live in sha256.cpp, the one used is picked once based on cpuid
+    using transform_fn = void (*)(uint32_t* hash_data, const uint8_t* message, size_t blocks);
+    static transform_fn select_transform();
+    static void transform_dispatch(uint32_t* hash_data, const uint8_t* message, size_t blocks);
+    static bool has_shani();
+    static bool has_avx2();
+    static void transform_shani(uint32_t* hash_data, const uint8_t* message, size_t blocks);
+    // runs the compression function over one block of eight independent messages, states are stored lane-major
+    static void transform_avx2_x8(uint32_t (*hash_data)[8], const uint8_t* const* message);
+
+private:
+    constexpr void transform(const uint8_t* message, size_t blocks)
+    {
+        if (std::is_constant_evaluated())
+            transform_portable(hash_data, message, blocks);
+        else
+            transform_dispatch(hash_data, message, blocks);
+    }
+
+    uint64_t tot_len;
     uint32_t curr_len;
     uint8_t hash_blocks[2 * BLOCK_SIZE];
     uint32_t hash_data[8];
@@ -132,8 +154,8 @@ public:
             curr_len += buf.size();
         else
         {
-            uint32_t new_len = buf.size() - rem_len;
-            uint32_t block_count = new_len / BLOCK_SIZE;
+            size_t new_len = buf.size() - rem_len;
+            size_t block_count = new_len / BLOCK_SIZE;
             shifted_message = buf.data() + rem_len;
 
             transform(hash_blocks, 1);
@@ -153,14 +175,15 @@ public:
         std::vector<uint8_t> digest;
         digest.resize(256 / 8);
         uint32_t block_nb = (1 + ((BLOCK_SIZE - 9) < (curr_len % BLOCK_SIZE)));
-        uint32_t len_b = (tot_len + curr_len) << 3;
+        uint64_t len_b = (tot_len + curr_len) << 3;
         uint32_t pm_len = block_nb << 6;
 
         memset(hash_blocks + curr_len, 0, pm_len - curr_len);
 
         hash_blocks[curr_len] = 0x80;
 
-        SHA2_UNPACK32(len_b, hash_blocks + pm_len - 4);
+        SHA2_UNPACK32((uint32_t)(len_b >> 32), hash_blocks + pm_len - 8);
+        SHA2_UNPACK32((uint32_t)len_b, hash_blocks + pm_len - 4);
 
         transform(hash_blocks, block_nb);
 
@@ -177,4 +200,8 @@ public:
         auto digest = get_digest();
         return fmt::format("{:0>2x}", fmt::join(digest, ""));
     }
+
+    // hashes several independent buffers at once, which lets the avx2 path run eight of them side by side in one register
+    // equivalent to calling update() and digest_str() on a fresh instance for each buffer
+    static std::vector<std::string> digest_str_many(const std::vector<std::span<uint8_t>>& bufs);
 };
@@ -0,0 +1,41 @@
+#include "sysinfo.h"
+#include <cstdio>
+#include <string>
+
+std::optional<long> mem_available()
+{
+    FILE* f = fopen("/proc/meminfo", "re");
+    if (!f)
+        return std::nullopt;
+
+    std::optional<long> result;
+    char line[256];
+    while (fgets(line, sizeof(line), f))
+    {
+        long kb;
+        if (sscanf(line, "MemAvailable: %ld kB", &kb) == 1)
+        {
+            result = kb;
+            break;
+        }
+    }
+
+    fclose(f);
+    return result;
+}
+
+std::optional<uint64_t> pressure_stall_us(const char* resource)
+{
+    std::string path = std::string("/proc/pressure/") + resource;
+    FILE* f = fopen(path.c_str(), "re");
+    if (!f)
+        return std::nullopt;
+
+    std::optional<uint64_t> result;
+    unsigned long long total;
+    if (fscanf(f, "some avg10=%*f avg60=%*f avg300=%*f total=%llu", &total) == 1)
+        result = total;
+
+    fclose(f);
+    return result;
+}
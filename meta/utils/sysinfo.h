@@ -0,0 +1,11 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+
+// MemAvailable from /proc/meminfo in kilobytes, the kernel's estimate of how much can be allocated without swapping; nullopt when
+// /proc is not there to ask
+std::optional<long> mem_available();
+
+// the "some" total of /proc/pressure/<resource> (cpu, memory or io): microseconds during which at least one task was stalled on it;
+// nullopt when the kernel was built without pressure stall information
+std::optional<uint64_t> pressure_stall_us(const char* resource);
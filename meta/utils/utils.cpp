@@ -31,3 +31,21 @@ std::vector<std::string> get_path()
 
     return search_path;
 }
+
+std::filesystem::path find_executable(const std::filesystem::path& exec)
+{
+    std::error_code ec;
+    if (exec.has_parent_path())
+    {
+        auto found = std::filesystem::canonical(exec, ec);
+        return ec ? std::filesystem::path() : found;
+    }
+
+    for (const auto& i : get_path())
+    {
+        auto found = std::filesystem::canonical(std::filesystem::path(i) / exec, ec);
+        if (!ec && std::filesystem::is_regular_file(found))
+            return found;
+    }
+    return {};
+}
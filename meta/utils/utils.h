@@ -3,6 +3,9 @@
 #include <vector>
 
 std::vector<std::string> get_path();
+// a bare name is looked up on get_path() the way exec does, anything with a directory in it is taken as is; the result has its symlinks
+// resolved, empty when nothing exists there
+std::filesystem::path find_executable(const std::filesystem::path& exec);
 
 inline std::filesystem::path normalize_path(const std::filesystem::path& p) { return std::filesystem::absolute(p).lexically_normal(); }
 
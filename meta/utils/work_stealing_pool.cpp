@@ -0,0 +1,134 @@
+#include "work_stealing_pool.h"
+#include <algorithm>
+
+// how often an idle worker goes around every other deque before it sleeps
+inline static constexpr int STEAL_ROUNDS = 2;
+
+// the pool and worker the calling thread belongs to, if any
+static thread_local work_stealing_pool* current_pool = nullptr;
+static thread_local size_t current_index = 0;
+
+work_stealing_pool::work_stealing_pool(size_t threads)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // every deque exists before any worker may try to steal from it
+    for (size_t i = 0; i < threads; i++)
+        workers.push_back(std::make_unique<worker>());
+    for (size_t i = 0; i < threads; i++)
+        workers[i]->thread = std::thread([this, i]() { run(i); });
+}
+
+work_stealing_pool::~work_stealing_pool()
+{
+    wait_for_tasks();
+    {
+        std::lock_guard g(sleep_mtx);
+        stopping = true;
+    }
+    sleep_cv.notify_all();
+    for (auto& i : workers)
+        i->thread.join();
+}
+
+void work_stealing_pool::push_task(task t)
+{
+    auto* item = new task(std::move(t));
+    pending.fetch_add(1);
+    // counted before it is visible, a worker that takes it right away must not drive the count below zero
+    queued.fetch_add(1);
+
+    if (current_pool == this)
+        workers[current_index]->tasks.push(item);
+    else
+    {
+        std::lock_guard g(injector_mtx);
+        injector.push_back(item);
+    }
+
+    // a worker counts itself as a sleeper before its last look at queued, so one of the two always sees the other
+    if (sleepers.load())
+    {
+        std::lock_guard g(sleep_mtx);
+        sleep_cv.notify_one();
+    }
+}
+
+void work_stealing_pool::wait_for_tasks()
+{
+    std::unique_lock g(done_mtx);
+    done_cv.wait(g, [this]() { return pending.load() == 0; });
+}
+
+work_stealing_pool::task* work_stealing_pool::find_task(size_t index, uint64_t& seed)
+{
+    if (auto* t = workers[index]->tasks.pop())
+        return t;
+
+    {
+        std::lock_guard g(injector_mtx);
+        if (!injector.empty())
+        {
+            auto* t = injector.front();
+            injector.pop_front();
+            return t;
+        }
+    }
+
+    // victims in a random order, so thieves do not all pile onto the same deque
+    size_t n = workers.size();
+    for (int round = 0; round < STEAL_ROUNDS && n > 1; round++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        size_t start = seed % n;
+        for (size_t i = 0; i < n; i++)
+        {
+            size_t victim = (start + i) % n;
+            if (victim == index)
+                continue;
+            if (auto* t = workers[victim]->tasks.steal())
+                return t;
+        }
+    }
+    return nullptr;
+}
+
+void work_stealing_pool::execute(task* t)
+{
+    queued.fetch_sub(1);
+    (*t)();
+    delete t;
+
+    if (pending.fetch_sub(1) == 1)
+    {
+        std::lock_guard g(done_mtx);
+        done_cv.notify_all();
+    }
+}
+
+void work_stealing_pool::run(size_t index)
+{
+    current_pool = this;
+    current_index = index;
+    uint64_t seed = 0x9e3779b97f4a7c15ull * (index + 1);
+
+    while (true)
+    {
+        if (auto* t = find_task(index, seed))
+        {
+            execute(t);
+            continue;
+        }
+
+        // nothing anywhere; queued can still be nonzero while a push or a take is halfway done, in which case we go around again
+        std::unique_lock g(sleep_mtx);
+        sleepers.fetch_add(1);
+        sleep_cv.wait(g, [this]() { return stopping || queued.load() > 0; });
+        sleepers.fetch_sub(1);
+        if (stopping && queued.load() == 0)
+            return;
+    }
+}
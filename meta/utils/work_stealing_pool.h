@@ -0,0 +1,156 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a Chase-Lev deque (Le, Pop, Cohen and Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory Models"): the owning thread
+// pushes and pops at the bottom without locking, any other thread steals from the top; it only synchronizes when both ends meet
+// items are pointers, ownership passes to whoever takes them
+template <typename T>
+class chase_lev_deque
+{
+    struct ring
+    {
+        int64_t mask;
+        std::unique_ptr<std::atomic<T*>[]> slots;
+
+        ring(int64_t capacity) : mask(capacity - 1), slots(new std::atomic<T*>[capacity]) {}
+        int64_t capacity() const { return mask + 1; }
+        T* get(int64_t i) const { return slots[i & mask].load(std::memory_order_relaxed); }
+        void put(int64_t i, T* x) { slots[i & mask].store(x, std::memory_order_relaxed); }
+    };
+
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::atomic<ring*> array;
+    // thieves may still be reading an outgrown ring, so rings are only freed with the deque
+    std::vector<std::unique_ptr<ring>> rings;
+
+public:
+    chase_lev_deque(int64_t capacity = 256)
+    {
+        rings.push_back(std::make_unique<ring>(capacity));
+        array.store(rings.back().get(), std::memory_order_relaxed);
+    }
+
+    chase_lev_deque(const chase_lev_deque&) = delete;
+    chase_lev_deque& operator=(const chase_lev_deque&) = delete;
+
+    // owner only
+    void push(T* x)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        ring* a = array.load(std::memory_order_relaxed);
+        if (b - t > a->capacity() - 1)
+        {
+            auto grown = std::make_unique<ring>(a->capacity() * 2);
+            for (int64_t i = t; i < b; i++)
+                grown->put(i, a->get(i));
+            a = grown.get();
+            rings.push_back(std::move(grown));
+            array.store(a, std::memory_order_release);
+        }
+        a->put(b, x);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // owner only, newest first; nullptr when empty
+    T* pop()
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        ring* a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        T* x = a->get(b);
+        if (t == b)
+        {
+            // the last item, which a thief may be taking at the same time
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                x = nullptr;
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return x;
+    }
+
+    // any thread, oldest first; nullptr when empty or when another thread got there first
+    T* steal()
+    {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+
+        T* x = array.load(std::memory_order_acquire)->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr;
+        return x;
+    }
+};
+
+// a thread pool where every worker owns a chase_lev_deque: tasks pushed from a worker go onto its own deque, so fan-out from inside tasks
+// never touches a lock, and idle workers steal the oldest tasks from the others; tasks pushed from outside the pool land in a shared
+// injector queue
+// the interface follows the parts of BS::thread_pool we use, tasks must not throw
+class work_stealing_pool
+{
+    using task = std::function<void()>;
+
+    struct worker
+    {
+        chase_lev_deque<task> tasks;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<worker>> workers;
+
+    std::mutex injector_mtx;
+    std::deque<task*> injector;
+
+    // tasks sitting in a deque or the injector, and tasks pushed but not yet finished
+    std::atomic<size_t> queued = 0;
+    std::atomic<size_t> pending = 0;
+
+    std::mutex sleep_mtx;
+    std::condition_variable sleep_cv;
+    std::atomic<size_t> sleepers = 0;
+    bool stopping = false;
+
+    std::mutex done_mtx;
+    std::condition_variable done_cv;
+
+    void run(size_t index);
+    task* find_task(size_t index, uint64_t& seed);
+    void execute(task* t);
+
+public:
+    // 0 starts one worker per hardware thread
+    work_stealing_pool(size_t threads = 0);
+    // waits for every task, then joins the workers
+    ~work_stealing_pool();
+
+    work_stealing_pool(const work_stealing_pool&) = delete;
+    work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+    void push_task(task t);
+    // blocks until every task pushed so far, and everything those pushed, has run; never call it from inside a task
+    void wait_for_tasks();
+    size_t get_thread_count() const { return workers.size(); }
+};